@@ -0,0 +1,186 @@
+// Times parsing and encoding through the public interface, over inputs that each consist of one kind of markup,
+// and reports ns/byte and allocations per node
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include "xml.hpp"
+#include "../test/allocation_counter.hpp"
+
+namespace
+{
+    volatile std::size_t sink = 0; // keeps the results of the stages alive
+
+    // Each stage is repeated until it runs at least this long
+    constexpr double minimumTime = 0.25;
+
+    // Returns the seconds one call of function takes
+    template <class Function>
+    double measure(const Function& function)
+    {
+        function(); // warm up the caches and the allocator
+
+        for (std::size_t iterations = 1;; iterations *= 2)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < iterations; ++i) function();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (elapsed.count() >= minimumTime)
+                return elapsed.count() / static_cast<double>(iterations);
+        }
+    }
+
+    // Returns the number of allocations one call of function makes
+    template <class Function>
+    std::size_t countAllocations(const Function& function)
+    {
+        const auto before = allocationCount.load();
+        function();
+        return allocationCount.load() - before;
+    }
+
+    std::size_t countNodes(const xml::Node& node)
+    {
+        std::size_t count = 1;
+        for (const auto& child : node) count += countNodes(child);
+        return count;
+    }
+
+    std::size_t countNodes(const xml::Data& data)
+    {
+        std::size_t count = 0;
+        for (const auto& node : data) count += countNodes(node);
+        return count;
+    }
+
+    void report(const char* stage, const std::size_t bytes, const double seconds)
+    {
+        std::printf("%-20s %10zu %10.3f %10.1f %14s\n", stage, bytes,
+                    seconds * 1e9 / static_cast<double>(bytes),
+                    static_cast<double>(bytes) / seconds / 1e6, "-");
+    }
+
+    void report(const char* stage, const std::size_t bytes, const double seconds,
+                const std::size_t allocations, const std::size_t nodes)
+    {
+        std::printf("%-20s %10zu %10.3f %10.1f %14.3f\n", stage, bytes,
+                    seconds * 1e9 / static_cast<double>(bytes),
+                    static_cast<double>(bytes) / seconds / 1e6,
+                    static_cast<double>(allocations) / static_cast<double>(nodes));
+    }
+
+    // Repeats str until the result is at least size bytes long
+    std::string repeat(const std::string_view str, const std::size_t size)
+    {
+        std::string result;
+        result.reserve(size + str.size());
+        while (result.size() < size) result += str;
+        return result;
+    }
+
+    std::string makeDocument(const std::size_t size)
+    {
+        std::string result = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<catalogue>\n";
+        for (std::size_t i = 0; result.size() < size; ++i)
+            result += "\t<item id=\"" + std::to_string(i) + "\" type=\"book\" price=\"12.50\">\n"
+                "\t\t<title>Title &amp; subtitle of the item number " + std::to_string(i) + "</title>\n"
+                "\t\t<!-- comment -->\n"
+                "\t\t<description>A description that is a little longer, with &lt;markup&gt; in it.</description>\n"
+                "\t\t<autor name=\"N\xC3\xA4me\"/>\n"
+                "\t</item>\n";
+        result += "</catalogue>\n";
+        return result;
+    }
+
+    // Wraps content, repeated until it is at least size bytes long, in a root element
+    std::string makeElement(const std::string_view content, const std::size_t size)
+    {
+        return "<root>" + repeat(content, size) + "</root>";
+    }
+
+    // Adds up the sizes of the reported names and values, so that the parsing is not optimized away
+    class Counter final: public xml::Handler
+    {
+    public:
+        void startElement(const std::string_view name, const xml::AttributesView& attributes)
+        {
+            size += name.size();
+            for (const auto& [key, value] : attributes) size += key.size() + value.size();
+        }
+
+        void text(const std::string_view value) { size += value.size(); }
+
+        std::size_t size = 0;
+    };
+
+    // Parses input without building any nodes
+    std::size_t scan(const std::string_view input)
+    {
+        Counter counter;
+        xml::parse(input, counter);
+        return counter.size;
+    }
+}
+
+int main()
+{
+    constexpr std::size_t size = 1024 * 1024;
+
+    const auto emptyTags = makeElement("<item/><title:name/><description_2/><data-value/><N\xC3\xA4me/>", size);
+    const auto references = makeElement("&amp;&lt;&gt;&quot;&apos;&#65;&#x20AC;", size);
+    const auto text = makeElement("Some text that does not need any decoding at all, ", size);
+    const auto startTags = makeElement("<item id=\"12345\" type='book' title=\"A &amp; B\" price=\"12.50\" available=\"true\"/>", size);
+    const auto escapable = repeat("Text with \"quotes\" & <markup> in it, mostly plain though. ", size);
+    const auto document = makeDocument(size);
+
+    xml::Data escapeData;
+    auto& root = escapeData.emplaceBack(xml::Node::Type::tag);
+    root.setName("root");
+    root.emplaceBack(escapable);
+
+    std::printf("%-20s %10s %10s %10s %14s\n", "stage", "bytes", "ns/byte", "MB/s", "allocs/node");
+
+    // the events of documents made of one kind of markup, without building nodes
+    report("scan empty tags", emptyTags.size(), measure([&]() {
+        sink = scan(emptyTags);
+    }));
+
+    report("scan references", references.size(), measure([&]() {
+        sink = scan(references);
+    }));
+
+    report("scan text", text.size(), measure([&]() {
+        sink = scan(text);
+    }));
+
+    report("scan attributes", startTags.size(), measure([&]() {
+        sink = scan(startTags);
+    }));
+
+    report("encode escaped text", escapable.size(), measure([&]() {
+        sink = xml::encode(escapeData).size();
+    }));
+
+    const auto data = xml::parse(document);
+    const auto nodes = countNodes(data);
+
+    report("parse", document.size(), measure([&]() {
+        const auto result = xml::parse(document);
+        sink = result.getChildren().size();
+    }), countAllocations([&]() {
+        const auto result = xml::parse(document);
+        sink = result.getChildren().size();
+    }), nodes);
+
+    const auto encoded = xml::encode(data);
+    report("encode", encoded.size(), measure([&]() {
+        sink = xml::encode(data).size();
+    }), countAllocations([&]() {
+        sink = xml::encode(data).size();
+    }), nodes);
+
+    return EXIT_SUCCESS;
+}
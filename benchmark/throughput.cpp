@@ -0,0 +1,562 @@
+// Parses and encodes generated documents of typical shapes and reports the median throughput of several
+// repetitions, latency percentiles and the peak memory of each shape. The throughput is also reported relative to
+// a reference kernel timed on the same document in the same run, which cancels out most of the speed of the machine;
+// with --baseline it fails if the relative throughput of any shape is below the one recorded in the file by
+// --write-baseline by more than the tolerance, or if the file has no entry for it.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#  include <sys/resource.h>
+#  include <sys/types.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+#include "xml.hpp"
+
+namespace
+{
+    // Deterministic on every platform, unlike the standard distributions
+    class Generator final
+    {
+    public:
+        explicit Generator(const std::uint32_t seed) noexcept: engine{seed} {}
+
+        std::size_t next(const std::size_t bound) noexcept
+        {
+            return static_cast<std::size_t>(engine() % bound);
+        }
+
+        std::string word()
+        {
+            static constexpr const char* words[] = {
+                "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+                "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "magna"
+            };
+            return words[next(std::size(words))];
+        }
+
+        std::string sentence(const std::size_t words)
+        {
+            std::string result;
+            for (std::size_t i = 0; i < words; ++i)
+            {
+                if (i) result += ' ';
+                result += word();
+            }
+            return result;
+        }
+
+    private:
+        std::mt19937 engine;
+    };
+
+    struct Shape final
+    {
+        const char* name;
+        std::function<void(Generator&, std::string&)> generate; // appends a child of the root element
+        const char* prologue = "";
+    };
+
+    const std::vector<Shape> shapes{
+        {"deep", [](Generator& generator, std::string& result) {
+            const auto depth = 200 + generator.next(300);
+            for (std::size_t i = 0; i < depth; ++i) result += "<level>";
+            result += generator.word();
+            for (std::size_t i = 0; i < depth; ++i) result += "</level>";
+        }},
+        {"wide", [](Generator& generator, std::string& result) {
+            for (std::size_t i = 0; i < 100; ++i)
+                result += "<item>" + generator.word() + "</item>";
+        }},
+        {"attributes", [](Generator& generator, std::string& result) {
+            result += "<record";
+            for (std::size_t i = 0; i < 8; ++i)
+                result += " attribute" + std::to_string(i) + "=\"" + generator.sentence(1 + generator.next(3)) + "\"";
+            result += "/>";
+        }},
+        {"text", [](Generator& generator, std::string& result) {
+            result += "<paragraph>" + generator.sentence(500 + generator.next(200)) + "</paragraph>";
+        }},
+        {"cdata", [](Generator& generator, std::string& result) {
+            result += "<script><![CDATA[if (a < b && c > d) { " + generator.sentence(100) + " }]]></script>";
+        }},
+        {"entities", [](Generator& generator, std::string& result) {
+            static constexpr const char* entities[] = {"&amp;", "&lt;", "&gt;", "&quot;", "&apos;", "&#65;", "&#x20AC;"};
+            result += "<escaped>";
+            for (std::size_t i = 0; i < 100; ++i)
+                result += generator.word() + entities[generator.next(std::size(entities))];
+            result += "</escaped>";
+        }},
+        {"unicode", [](Generator& generator, std::string& result) {
+            result += "<donn\xC3\xA9" "es \xE5\x90\x8D\xE5\x89\x8D=\"" + generator.word() + "\">"
+                "<\xCE\xB5\xCE\xBB\xCE\xBB\xCE\xB7\xCE\xBD\xCE\xB9\xCE\xBA\xCE\xAC>" + generator.sentence(5) +
+                "</\xCE\xB5\xCE\xBB\xCE\xBB\xCE\xB7\xCE\xBD\xCE\xB9\xCE\xBA\xCE\xAC></donn\xC3\xA9" "es>";
+        }},
+        {"dtd", [](Generator& generator, std::string& result) {
+            result += "<entry id=\"" + std::to_string(generator.next(1000000)) + "\">" + generator.sentence(10) + "</entry>";
+        }, "<!DOCTYPE root [\n"
+            "<!ELEMENT root (entry*)>\n"
+            "<!ELEMENT entry (#PCDATA)>\n"
+            "<!ATTLIST entry id CDATA #REQUIRED>\n"
+            "<!ENTITY copyright \"Copyright\">\n"
+            "<!NOTATION png SYSTEM \"image/png\">\n"
+            "]>\n"}
+    };
+
+    std::string generate(const Shape& shape, const std::size_t size)
+    {
+        Generator generator{12345};
+
+        std::string result = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        result += shape.prologue;
+        result += "<root>";
+        while (result.size() < size) shape.generate(generator, result);
+        result += "</root>";
+        return result;
+    }
+
+    struct Statistics final
+    {
+        double throughput; // MB/s
+        double p50; // latencies in microseconds
+        double p99;
+        double p999;
+    };
+
+    // Calls function warmUp times, then measures iterations calls that process bytes each
+    template <class Function>
+    Statistics measureOnce(const Function& function, const std::size_t bytes,
+                           const std::size_t warmUp, const std::size_t iterations)
+    {
+        for (std::size_t i = 0; i < warmUp; ++i) function();
+
+        std::vector<double> latencies;
+        latencies.reserve(iterations);
+
+        double total = 0.0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            function();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            latencies.push_back(elapsed.count() * 1e6);
+            total += elapsed.count();
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&latencies](const double p) {
+            const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(latencies.size())));
+            return latencies[std::min(latencies.size(), std::max<std::size_t>(rank, 1)) - 1];
+        };
+
+        return Statistics{static_cast<double>(bytes) * static_cast<double>(iterations) / total / 1e6,
+                          percentile(0.5), percentile(0.99), percentile(0.999)};
+    }
+
+    struct Measurement final
+    {
+        Statistics statistics; // of the repetition with the median throughput
+        std::vector<double> relatives; // throughputs relative to the reference in the same repetition
+    };
+
+    // Measures function and reference in turns repetitions times, so that a change in the load of the machine
+    // affects both alike; the medians are not skewed by a single repetition disturbed by the rest of the system
+    template <class Function, class Reference>
+    Measurement measure(const Function& function, const std::size_t bytes,
+                        const Reference& reference, const std::size_t referenceBytes,
+                        const std::size_t warmUp, const std::size_t iterations, const std::size_t repetitions)
+    {
+        std::vector<Statistics> runs;
+        std::vector<double> relatives;
+        runs.reserve(repetitions);
+        relatives.reserve(repetitions);
+        for (std::size_t i = 0; i < repetitions; ++i)
+        {
+            const auto referenceRun = measureOnce(reference, referenceBytes, warmUp, iterations);
+            runs.push_back(measureOnce(function, bytes, warmUp, iterations));
+            relatives.push_back(runs.back().throughput / referenceRun.throughput);
+        }
+
+        const auto middle = static_cast<std::ptrdiff_t>(repetitions / 2);
+        std::nth_element(runs.begin(), runs.begin() + middle, runs.end(), [](const Statistics& a, const Statistics& b) {
+            return a.throughput < b.throughput;
+        });
+        return Measurement{runs[static_cast<std::size_t>(middle)], std::move(relatives)};
+    }
+
+    double median(std::vector<double> values)
+    {
+        const auto middle = values.begin() + static_cast<std::ptrdiff_t>(values.size() / 2);
+        std::nth_element(values.begin(), middle, values.end());
+        return *middle;
+    }
+
+    // Peak resident set size of the process in MiB, 0 where it is not available; the shapes are measured in
+    // processes of their own where possible, so that this is the peak of one shape and not of all of them so far
+    double getPeakResidentSize()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#  if defined(__APPLE__)
+        return static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0); // bytes
+#  else
+        return static_cast<double>(usage.ru_maxrss) / 1024.0; // kilobytes
+#  endif
+#else
+        return 0.0;
+#endif
+    }
+
+    // Splits the data into the runs between angle brackets and copies each of them into a string of its own,
+    // the same kinds of work as parsing and encoding: a vectorized search for delimiters, a loop over the tokens
+    // and an allocation for each of them, so its speed follows the speed of the machine for all of the shapes
+    std::size_t tokenize(const std::string_view data)
+    {
+        std::vector<std::string> tokens;
+        for (std::size_t position = 0; position < data.size();)
+        {
+            const auto delimiter = static_cast<char>(tokens.size() % 2 ? '>' : '<');
+            const auto found = std::memchr(data.data() + position, delimiter, data.size() - position);
+            const auto end = found ? static_cast<std::size_t>(static_cast<const char*>(found) - data.data()) : data.size();
+
+            tokens.emplace_back(data.substr(position, end - position));
+            position = end + 1;
+        }
+
+        return tokens.size();
+    }
+
+    using Results = std::map<std::string, double>; // "shape operation" to throughput relative to the reference
+
+    Results readResults(std::istream& stream)
+    {
+        Results results;
+        for (std::string line; std::getline(stream, line);)
+        {
+            if (line.empty() || line.front() == '#') continue;
+
+            std::istringstream lineStream{line};
+            std::string shape;
+            std::string operation;
+            double relative;
+            if (!(lineStream >> shape >> operation >> relative))
+                throw std::runtime_error{"Invalid baseline line: " + line};
+
+            results[shape + ' ' + operation] = relative;
+        }
+
+        return results;
+    }
+
+    void writeResults(std::ostream& stream, const Results& results)
+    {
+        stream.precision(4);
+        for (const auto& [key, relative] : results)
+            stream << key << ' ' << relative << '\n';
+    }
+
+    Results readBaseline(const std::string& path)
+    {
+        std::ifstream file{path};
+        if (!file)
+            throw std::runtime_error{"Failed to open " + path};
+
+        return readResults(file);
+    }
+
+    void writeBaseline(const std::string& path, const Results& results)
+    {
+        std::ofstream file{path};
+        if (!file)
+            throw std::runtime_error{"Failed to open " + path};
+
+        file << "# shape operation throughput relative to the reference kernel, written by throughput --write-baseline\n";
+        writeResults(file, results);
+    }
+
+    struct Options final
+    {
+        std::size_t size = 64 * 1024;
+        std::size_t iterations = 1000;
+        std::size_t repetitions = 5;
+        bool check = false; // compare with the baseline
+        double tolerance = 0.25;
+        std::size_t retries = 2;
+    };
+
+    // Measures the operations on the shape, prints a line for each of them and adds them to results;
+    // returns whether any of them regressed
+    bool measureShape(const Shape& shape, const Options& options, const Results& baseline, Results& results)
+    {
+        bool regressed = false;
+
+        const auto document = generate(shape, options.size);
+        const auto data = xml::parse(document);
+        const auto encoded = xml::encode(data);
+        const auto warmUp = std::max<std::size_t>(options.iterations / 10, 1);
+
+        const auto reference = [&document]() {
+            if (tokenize(document) == 0) std::abort();
+        };
+
+        const std::tuple<const char*, std::function<void()>, std::size_t> operations[] = {
+            {"parse", [&document]() {
+                const auto result = xml::parse(document);
+                if (result.getChildren().empty()) std::abort();
+            }, document.size()},
+            {"encode", [&data]() {
+                const auto result = xml::encode(data);
+                if (result.empty()) std::abort();
+            }, encoded.size()}
+        };
+
+        for (const auto& [operation, function, bytes] : operations)
+        {
+            const auto key = std::string{shape.name} + ' ' + operation;
+            auto measurement = measure(function, bytes, reference, document.size(), warmUp,
+                                       options.iterations, options.repetitions);
+            auto relative = median(measurement.relatives);
+
+            std::printf("%-12s %-8s %10zu %10.1f %10.4f %10.1f %10.1f %10.1f %10.1f",
+                        shape.name, operation, bytes,
+                        measurement.statistics.throughput, relative,
+                        measurement.statistics.p50, measurement.statistics.p99, measurement.statistics.p999,
+                        getPeakResidentSize());
+
+            if (options.check)
+            {
+                if (const auto i = baseline.find(key); i == baseline.end())
+                {
+                    std::printf(" MISSING");
+                    regressed = true;
+                }
+                else
+                {
+                    // a drop is measured again, and the median of the repetitions of all the runs is compared
+                    if (relative / i->second - 1.0 < -options.tolerance && options.retries > 0)
+                    {
+                        for (std::size_t retry = 0; retry < options.retries; ++retry)
+                        {
+                            const auto again = measure(function, bytes, reference, document.size(), warmUp,
+                                                       options.iterations, options.repetitions);
+                            measurement.relatives.insert(measurement.relatives.end(),
+                                                         again.relatives.begin(), again.relatives.end());
+                        }
+
+                        relative = median(measurement.relatives);
+                        std::printf(" %10.4f after %zu runs", relative, options.retries + 1);
+                    }
+
+                    const auto change = relative / i->second - 1.0;
+                    std::printf(" %+6.1f%%", change * 100.0);
+                    if (change < -options.tolerance)
+                    {
+                        std::printf(" REGRESSION");
+                        regressed = true;
+                    }
+                }
+            }
+
+            std::printf("\n");
+            results[key] = relative;
+        }
+
+        return regressed;
+    }
+
+    // Runs measureShape in a child process where possible and passes its results back through a pipe
+    bool measureShapeIsolated(const Shape& shape, const Options& options, const Results& baseline, Results& results)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        int descriptors[2];
+        if (::pipe(descriptors) != 0)
+            throw std::runtime_error{"Failed to create a pipe"};
+
+        std::fflush(stdout);
+
+        const auto child = ::fork();
+        if (child == -1)
+        {
+            ::close(descriptors[0]);
+            ::close(descriptors[1]);
+            throw std::runtime_error{"Failed to start a process"};
+        }
+
+        if (child == 0)
+        {
+            ::close(descriptors[0]);
+
+            int status = 2;
+            try
+            {
+                Results shapeResults;
+                status = measureShape(shape, options, baseline, shapeResults) ? 1 : 0;
+
+                std::ostringstream stream;
+                writeResults(stream, shapeResults);
+                const auto output = stream.str();
+                for (std::size_t offset = 0; offset < output.size();)
+                    if (const auto count = ::write(descriptors[1], output.data() + offset, output.size() - offset); count > 0)
+                        offset += static_cast<std::size_t>(count);
+                    else if (errno != EINTR)
+                        throw std::runtime_error{"Failed to write to the pipe"};
+            }
+            catch (const std::exception& e)
+            {
+                std::fprintf(stderr, "%s\n", e.what());
+                status = 2;
+            }
+
+            std::fflush(stdout);
+            std::fflush(stderr);
+            ::_exit(status);
+        }
+
+        ::close(descriptors[1]);
+
+        std::string output;
+        char buffer[4096];
+        for (;;)
+            if (const auto count = ::read(descriptors[0], buffer, sizeof(buffer)); count > 0)
+                output.append(buffer, static_cast<std::size_t>(count));
+            else if (count == 0 || errno != EINTR)
+                break;
+        ::close(descriptors[0]);
+
+        int status = 0;
+        while (::waitpid(child, &status, 0) == -1)
+            if (errno != EINTR)
+                throw std::runtime_error{"Failed to wait for a process"};
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) > 1)
+            throw std::runtime_error{std::string{"Failed to measure "} + shape.name};
+
+        std::istringstream stream{output};
+        for (const auto& [key, relative] : readResults(stream))
+            results[key] = relative;
+
+        return WEXITSTATUS(status) == 1;
+#else
+        return measureShape(shape, options, baseline, results);
+#endif
+    }
+
+    // Parses the whole value or throws std::invalid_argument or std::out_of_range
+    template <class T, class Parse>
+    T parseArgument(const std::string& value, const Parse& parse)
+    {
+        std::size_t length = 0;
+        const auto result = parse(value, &length);
+        if (length != value.size() || value.front() == '-')
+            throw std::invalid_argument{"Invalid argument " + value};
+
+        return static_cast<T>(result);
+    }
+
+    std::size_t parseCount(const std::string& value)
+    {
+        return parseArgument<std::size_t>(value, [](const std::string& str, std::size_t* length) {
+            return std::stoull(str, length);
+        });
+    }
+
+    double parseFraction(const std::string& value)
+    {
+        return parseArgument<double>(value, [](const std::string& str, std::size_t* length) {
+            return std::stod(str, length);
+        });
+    }
+
+    void printUsage()
+    {
+        std::fprintf(stderr, "Usage: throughput [--size bytes] [--iterations count] [--repetitions count] [--shape name]\n"
+                             "                  [--baseline file [--tolerance fraction] [--retries count]] [--write-baseline file]\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    std::string only;
+    std::string baselinePath;
+    std::string outputPath;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            if (i + 1 == argc)
+            {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+
+            const std::string value = argv[++i];
+            if (argument == "--size") options.size = parseCount(value);
+            else if (argument == "--iterations") options.iterations = std::max<std::size_t>(parseCount(value), 1);
+            else if (argument == "--repetitions") options.repetitions = std::max<std::size_t>(parseCount(value), 1);
+            else if (argument == "--shape") only = value;
+            else if (argument == "--baseline") baselinePath = value;
+            else if (argument == "--tolerance") options.tolerance = parseFraction(value);
+            else if (argument == "--retries") options.retries = parseCount(value);
+            else if (argument == "--write-baseline") outputPath = value;
+            else
+            {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    catch (const std::logic_error&)
+    {
+        // std::invalid_argument or std::out_of_range from a number that could not be parsed
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        options.check = !baselinePath.empty();
+        const auto baseline = options.check ? readBaseline(baselinePath) : Results{};
+        Results results;
+        bool regressed = false;
+
+        std::printf("%-12s %-8s %10s %10s %10s %10s %10s %10s %10s\n",
+                    "shape", "op", "bytes", "MB/s", "relative", "p50 us", "p99 us", "p999 us", "peak MiB");
+
+        for (const auto& shape : shapes)
+        {
+            if (!only.empty() && only != shape.name) continue;
+
+            regressed = measureShapeIsolated(shape, options, baseline, results) || regressed;
+        }
+
+        if (!outputPath.empty()) writeBaseline(outputPath, results);
+
+        return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+}
@@ -1,15 +1,70 @@
 #ifndef XML_HPP
 #define XML_HPP
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
-#include <map>
+#include <deque>
+#include <exception>
+#include <forward_list>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#if __has_include(<memory_resource>)
+#  include <memory_resource>
+#endif
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#if !defined(XML_NO_SIMD)
+#  if defined(__AVX2__)
+#    define XML_SIMD_AVX2
+#    include <immintrin.h>
+#  elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define XML_SIMD_SSE2
+#    include <emmintrin.h>
+#  elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#    define XML_SIMD_NEON
+#    include <arm_neon.h>
+#  endif
+#endif
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define XML_POSIX
+#  include <unistd.h>
+#endif
+
+#if !defined(XML_NO_MMAP) && defined(XML_POSIX)
+#  define XML_MMAP
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
 namespace xml
 {
     class ParseError final: public std::logic_error
@@ -24,9 +79,49 @@ namespace xml
         using range_error::range_error;
     };
 
-    using Attributes = std::map<std::string, std::string, std::less<>>;
+    class Reader;
+
+    template <class HandlerType>
+    class PushParser;
+
+    // Elements nested deeper than this are rejected unless another limit is passed to parse
+    inline constexpr std::size_t defaultMaxDepth = 1024;
+
+    // Parse options fixed at compile time, e.g. parse<Flags::preserveComments | Flags::preserveWhiteSpaces>(data);
+    // everything that is not requested is dropped
+    enum class Flags: std::uint8_t
+    {
+        none = 0,
+        preserveWhiteSpaces = 1,
+        preserveComments = 2,
+        preserveProcessingInstructions = 4
+    };
+
+    [[nodiscard]]
+    constexpr Flags operator|(const Flags a, const Flags b) noexcept
+    {
+        return static_cast<Flags>(static_cast<std::uint8_t>(a) | static_cast<std::uint8_t>(b));
+    }
+
+    [[nodiscard]]
+    constexpr Flags operator&(const Flags a, const Flags b) noexcept
+    {
+        return static_cast<Flags>(static_cast<std::uint8_t>(a) & static_cast<std::uint8_t>(b));
+    }
+
+    inline namespace detail
+    {
+        class Parser;
+
+        template <class Document>
+        class Builder;
+
+        class FlatBuilder;
+        template <class HandlerType> class Projector;
+    }
 
-    class Node final
+    // Node kinds shared by every node representation
+    class NodeBase
     {
     public:
         enum class Type
@@ -49,21 +144,64 @@ namespace xml
             system,
             pub
         };
+    };
 
-        Node() = default;
-        Node(const Type initType): type{initType} {}
-        Node(std::string&& val) noexcept: type{Type::text}, value{std::move(val)} {}
+    // Node whose strings, attributes and children are allocated with Allocator
+    template <class Allocator>
+    class BasicNode final: public NodeBase
+    {
+        template <class Document> friend class detail::Builder;
 
-        template <class Source>
-        Node(const Source& val): type{Type::text}, value{std::string{val}} {}
+        template <class T>
+        using Rebind = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    public:
+        using allocator_type = Allocator;
+        using String = std::basic_string<char, std::char_traits<char>, Rebind<char>>;
+        // Attributes in document order; elements have few, so a linear search beats a tree
+        using Attributes = std::vector<std::pair<String, String>, Rebind<std::pair<String, String>>>;
+
+        BasicNode() = default;
+        explicit BasicNode(const allocator_type& allocator):
+            name(allocator), value(allocator), attributes(allocator), children(allocator) {}
+        BasicNode(const Type initType, const allocator_type& allocator = allocator_type{}):
+            type{initType}, name(allocator), value(allocator), attributes(allocator), children(allocator) {}
+        BasicNode(String&& val) noexcept: type{Type::text}, value{std::move(val)} {}
+        BasicNode(String&& val, const allocator_type& allocator):
+            type{Type::text}, name(allocator), value(std::move(val), allocator), attributes(allocator), children(allocator) {}
 
-        Node& operator=(const Type newType) noexcept
+        template <class Source>
+        BasicNode(const Source& val, const allocator_type& allocator = allocator_type{}):
+            type{Type::text}, name(allocator), value(val, allocator), attributes(allocator), children(allocator) {}
+
+        BasicNode(const BasicNode&) = default;
+        BasicNode(BasicNode&&) = default;
+
+        BasicNode(const BasicNode& other, const allocator_type& allocator):
+            type{other.type},
+            name(other.name, allocator),
+            externalIdType{other.externalIdType},
+            value(other.value, allocator),
+            attributes(other.attributes, allocator),
+            children(other.children, allocator) {}
+
+        BasicNode(BasicNode&& other, const allocator_type& allocator):
+            type{other.type},
+            name(std::move(other.name), allocator),
+            externalIdType{other.externalIdType},
+            value(std::move(other.value), allocator),
+            attributes(std::move(other.attributes), allocator),
+            children(std::move(other.children), allocator) {}
+
+        BasicNode& operator=(const BasicNode&) = default;
+        BasicNode& operator=(BasicNode&&) = default;
+
+        BasicNode& operator=(const Type newType) noexcept
         {
             type = newType;
             return *this;
         }
 
-        Node& operator=(std::string&& val) noexcept
+        BasicNode& operator=(String&& val) noexcept
         {
             type = Type::text;
             value = std::move(val);
@@ -71,13 +209,15 @@ namespace xml
         }
 
         template <class Source>
-        Node& operator=(const Source& val)
+        BasicNode& operator=(const Source& val)
         {
             type = Type::text;
-            value = std::string{val};
+            value = val;
             return *this;
         }
 
+        [[nodiscard]] allocator_type get_allocator() const noexcept { return value.get_allocator(); }
+
         [[nodiscard]] Type getType() const noexcept { return type; }
         void setType(const Type newType) noexcept { type = newType; }
 
@@ -103,26 +243,27 @@ namespace xml
 
         [[nodiscard]] const auto& operator[](const std::string_view attribute) const
         {
-            if (const auto iterator = attributes.find(attribute); iterator != attributes.end())
-                return iterator->second;
-            else
-                throw RangeError{"Invalid attribute"};
+            for (const auto& [key, attributeValue] : attributes)
+                if (key == attribute) return attributeValue;
+
+            throw RangeError{"Invalid attribute"};
         }
 
         [[nodiscard]] auto& operator[](const std::string_view attribute) noexcept
         {
-            if (const auto iterator = attributes.find(attribute); iterator != attributes.end())
-                return iterator->second;
-            else
-            {
-                const auto [newIterator, success] = attributes.try_emplace(std::string{attribute});
-                (void)success;
-                return newIterator->second;
-            }
+            for (auto& [key, attributeValue] : attributes)
+                if (key == attribute) return attributeValue;
+
+            return attributes.emplace_back(String{attribute, value.get_allocator()},
+                                           String{value.get_allocator()}).second;
         }
 
         [[nodiscard]] const auto& getChildren() const noexcept { return children; }
-        void pushBack(const Node& node) { children.push_back(node); }
+        void pushBack(const BasicNode& node) { children.push_back(node); }
+        void pushBack(BasicNode&& node) { children.push_back(std::move(node)); }
+
+        template <class... Args>
+        BasicNode& emplaceBack(Args&&... args) { return children.emplace_back(std::forward<Args>(args)...); }
 
         [[nodiscard]] const auto& getName() const noexcept { return name; }
         void setName(const std::string_view newName) { name = newName; }
@@ -138,17 +279,25 @@ namespace xml
 
     private:
         Type type = Type::tag;
-        std::string name;
-        ExternalIdType externalIdType;
-        std::string value;
+        String name;
+        ExternalIdType externalIdType = ExternalIdType::none;
+        String value;
         Attributes attributes;
-        std::vector<Node> children;
+        std::vector<BasicNode, Rebind<BasicNode>> children;
     };
 
-    class Data final
+    // Document whose nodes are allocated with Allocator
+    template <class Allocator>
+    class BasicData final
     {
     public:
-        Data() = default;
+        using allocator_type = Allocator;
+        using value_type = BasicNode<Allocator>;
+
+        BasicData() = default;
+        explicit BasicData(const allocator_type& allocator): children(allocator) {}
+
+        [[nodiscard]] allocator_type get_allocator() const noexcept { return children.get_allocator(); }
 
         [[nodiscard]] auto begin() noexcept
         {
@@ -171,1061 +320,4380 @@ namespace xml
         }
 
         [[nodiscard]] const auto& getChildren() const noexcept { return children; }
-        void pushBack(const Node& node) { children.push_back(node); }
+        void pushBack(const value_type& node) { children.push_back(node); }
+        void pushBack(value_type&& node) { children.push_back(std::move(node)); }
+
+        template <class... Args>
+        value_type& emplaceBack(Args&&... args) { return children.emplace_back(std::forward<Args>(args)...); }
 
     private:
-        std::vector<Node> children;
+        std::vector<value_type, typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>> children;
     };
 
-    inline namespace detail
+    using Node = BasicNode<std::allocator<char>>;
+    using Data = BasicData<std::allocator<char>>;
+    using Attributes = Node::Attributes;
+
+#if defined(__cpp_lib_memory_resource)
+    // Documents allocated from a std::pmr::memory_resource, e.g. a monotonic arena
+    // that is released at once when the document is no longer needed
+    namespace pmr
     {
-        constexpr std::array<std::uint8_t, 3> utf8ByteOrderMark = {0xEF, 0xBB, 0xBF};
+        using Node = BasicNode<std::pmr::polymorphic_allocator<char>>;
+        using Data = BasicData<std::pmr::polymorphic_allocator<char>>;
+        using Attributes = Node::Attributes;
     }
+#endif
 
-    template <class Iterator>
-    Data parse(const Iterator begin, const Iterator end,
-               bool preserveWhiteSpaces = false,
-               bool preserveComments = false,
-               bool preserveProcessingInstructions = false)
+    // Attributes of a NodeView in document order
+    using AttributesView = std::vector<std::pair<std::string_view, std::string_view>>;
+
+    // Read-only node whose strings refer to the parsed buffer
+    class NodeView final
     {
-        class Parser final
-        {
-        public:
-            [[nodiscard]]
-            static std::u32string toUtf32(const Iterator begin, const Iterator end)
-            {
-                std::u32string result;
+        template <class Document> friend class detail::Builder;
+    public:
+        using Type = Node::Type;
+        using ExternalIdType = Node::ExternalIdType;
 
-                for (auto i = begin; i != end; ++i)
-                {
-                    char32_t cp = static_cast<char32_t>(*i) & 0xFF;
+        NodeView() = default;
+        NodeView(const Type initType) noexcept: type{initType} {}
+        NodeView(const std::string_view val) noexcept: type{Type::text}, value{val} {}
 
-                    if (cp <= 0x7F) // length = 1
-                    {
-                        // do nothing
-                    }
-                    else if ((cp >> 5) == 0x6) // length = 2
-                    {
-                        if (++i == end)
-                            throw ParseError{"Invalid UTF-8 string"};
-                        cp = ((cp << 6) & 0x7FF) + (static_cast<char32_t>(*i) & 0x3F);
-                    }
-                    else if ((cp >> 4) == 0xE) // length = 3
-                    {
-                        if (++i == end)
-                            throw ParseError{"Invalid UTF-8 string"};
-                        cp = ((cp << 12) & 0xFFFF) + (((static_cast<char32_t>(*i) & 0xFF) << 6) & 0x0FFF);
-                        if (++i == end)
-                            throw ParseError{"Invalid UTF-8 string"};
-                        cp += static_cast<char32_t>(*i) & 0x3F;
-                    }
-                    else if ((cp >> 3) == 0x1E) // length = 4
-                    {
-                        if (++i == end)
-                            throw ParseError{"Invalid UTF-8 string"};
-                        cp = ((cp << 18) & 0x1FFFFF) + (((static_cast<char32_t>(*i) & 0xFF) << 12) & 0x3FFFF);
-                        if (++i == end)
-                            throw ParseError{"Invalid UTF-8 string"};
-                        cp += ((static_cast<char32_t>(*i) & 0xFF) << 6) & 0x0FFF;
-                        if (++i == end)
-                            throw ParseError{"Invalid UTF-8 string"};
-                        cp += static_cast<char32_t>(*i) & 0x3F;
-                    }
+        [[nodiscard]] Type getType() const noexcept { return type; }
 
-                    result.push_back(cp);
-                }
+        [[nodiscard]] auto begin() const noexcept
+        {
+            return children.begin();
+        }
 
-                return result;
-            }
+        [[nodiscard]] auto end() const noexcept
+        {
+            return children.end();
+        }
 
-            [[nodiscard]] static std::string fromUtf32(const char32_t c)
-            {
-                std::string result;
+        [[nodiscard]] std::string_view operator[](const std::string_view attribute) const
+        {
+            for (const auto& [key, attributeValue] : attributes)
+                if (key == attribute) return attributeValue;
 
-                if (c <= 0x7F)
-                    result.push_back(static_cast<char>(c));
-                else if (c <= 0x7FF)
-                {
-                    result.push_back(static_cast<char>(0xC0 | ((c >> 6) & 0x1F)));
-                    result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
-                }
-                else if (c <= 0xFFFF)
-                {
-                    result.push_back(static_cast<char>(0xE0 | ((c >> 12) & 0x0F)));
-                    result.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
-                    result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
-                }
-                else
-                {
-                    result.push_back(static_cast<char>(0xF0 | ((c >> 18) & 0x07)));
-                    result.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
-                    result.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
-                    result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
-                }
+            throw RangeError{"Invalid attribute"};
+        }
 
-                return result;
-            }
+        [[nodiscard]] const auto& getChildren() const noexcept { return children; }
+        [[nodiscard]] std::string_view getName() const noexcept { return name; }
+        [[nodiscard]] ExternalIdType getExternalIdType() const noexcept { return externalIdType; }
+        [[nodiscard]] std::string_view getValue() const noexcept { return value; }
+        [[nodiscard]] const auto& getAttributes() const noexcept { return attributes; }
 
-            [[nodiscard]]
-            static std::string fromUtf32(const std::u32string::const_iterator begin,
-                                         const std::u32string::const_iterator end)
-            {
-                std::string result;
+    private:
+        NodeView& operator=(const Type newType) noexcept
+        {
+            type = newType;
+            return *this;
+        }
 
-                for (auto i = begin; i != end; ++i)
-                {
-                    if (*i <= 0x7F)
-                        result.push_back(static_cast<char>(*i));
-                    else if (*i <= 0x7FF)
-                    {
-                        result.push_back(static_cast<char>(0xC0 | ((*i >> 6) & 0x1F)));
-                        result.push_back(static_cast<char>(0x80 | (*i & 0x3F)));
-                    }
-                    else if (*i <= 0xFFFF)
-                    {
-                        result.push_back(static_cast<char>(0xE0 | ((*i >> 12) & 0x0F)));
-                        result.push_back(static_cast<char>(0x80 | ((*i >> 6) & 0x3F)));
-                        result.push_back(static_cast<char>(0x80 | (*i & 0x3F)));
-                    }
-                    else
-                    {
-                        result.push_back(static_cast<char>(0xF0 | ((*i >> 18) & 0x07)));
-                        result.push_back(static_cast<char>(0x80 | ((*i >> 12) & 0x3F)));
-                        result.push_back(static_cast<char>(0x80 | ((*i >> 6) & 0x3F)));
-                        result.push_back(static_cast<char>(0x80 | (*i & 0x3F)));
-                    }
-                }
+        void pushBack(NodeView&& node) { children.push_back(std::move(node)); }
+        void setName(const std::string_view newName) noexcept { name = newName; }
+        void setValue(const std::string_view newValue) noexcept { value = newValue; }
 
-                return result;
-            }
+        Type type = Type::tag;
+        std::string_view name;
+        ExternalIdType externalIdType = ExternalIdType::none;
+        std::string_view value;
+        AttributesView attributes;
+        std::vector<NodeView> children;
+    };
 
-            [[nodiscard]] static std::string fromUtf32(const std::u32string& text)
-            {
-                return fromUtf32(std::begin(text), std::end(text));
-            }
+    class AtomTable;
 
-            [[nodiscard]]
-            static Data parse(const Iterator begin, const Iterator end,
-                              const bool preserveWhiteSpaces,
-                              const bool preserveComments,
-                              const bool preserveProcessingInstructions)
-            {
-                bool byteOrderMark = hasByteOrderMark(begin, end);
+    // Read-only document that refers to the parsed buffer, which must outlive it;
+    // only values with entity references are decoded into storage owned by the document
+    // and names are interned into its atom table if it has one
+    class DataView final
+    {
+        template <class Document> friend class detail::Builder;
+    public:
+        using value_type = NodeView;
 
-                const auto str = toUtf32(byteOrderMark ? begin + 3 : begin, end);
-                auto iterator = str.begin();
-                bool rootTagFound = false;
-                bool prologAllowed = true;
+        DataView() = default;
+        explicit DataView(std::shared_ptr<AtomTable> initAtoms) noexcept: atoms{std::move(initAtoms)} {}
+        DataView(const DataView&) = delete;
+        DataView& operator=(const DataView&) = delete;
+        DataView(DataView&&) noexcept = default;
+        DataView& operator=(DataView&&) noexcept = default;
 
-                Data result;
+        [[nodiscard]] auto begin() const noexcept
+        {
+            return children.begin();
+        }
 
-                for (;;)
-                {
-                    if (!preserveWhiteSpaces) skipWhiteSpaces(iterator, str.end());
+        [[nodiscard]] auto end() const noexcept
+        {
+            return children.end();
+        }
 
-                    if (iterator == str.end()) break;
+        [[nodiscard]] const auto& getChildren() const noexcept { return children; }
 
-                    const auto node = parse(iterator, str.end(),
-                                            preserveWhiteSpaces,
-                                            preserveComments,
-                                            preserveProcessingInstructions,
-                                            prologAllowed);
+        // Table that holds the element and attribute names, nullptr if they refer to the parsed buffer
+        [[nodiscard]] AtomTable* getAtoms() const noexcept { return atoms.get(); }
 
-                    if ((preserveComments || node.getType() != Node::Type::comment) &&
-                        (preserveProcessingInstructions || node.getType() != Node::Type::processingInstruction))
-                    {
-                        result.pushBack(node);
+    private:
+        void pushBack(NodeView&& node) { children.push_back(std::move(node)); }
 
-                        if (node.getType() == Node::Type::tag)
-                        {
-                            if (rootTagFound)
-                                throw ParseError{"Multiple root tags found"};
-                            else
-                                rootTagFound = true;
-                        }
-                    }
+        [[nodiscard]] std::string_view store(const std::string_view value)
+        {
+            return strings.emplace_front(value);
+        }
 
-                    prologAllowed = false;
-                }
+        std::vector<NodeView> children;
+        std::forward_list<std::string> strings; // nodes of the list never move
+        std::shared_ptr<AtomTable> atoms;
+    };
 
-                if (!rootTagFound)
-                    throw ParseError{"No root tag found"};
+    // Set of unique names, each stored once. Equal names interned in the same table are returned
+    // as views of the same characters, so they can be compared by address. A shared table can be
+    // used from several threads at once.
+    class AtomTable final
+    {
+        friend class detail::FlatBuilder;
+    public:
+        explicit AtomTable(const bool initShared = false) noexcept: shared{initShared} {}
 
-                return result;
-            }
+        AtomTable(const AtomTable&) = delete;
+        AtomTable& operator=(const AtomTable&) = delete;
 
-        private:
-            [[nodiscard]]
-            static bool hasByteOrderMark(const Iterator begin, const Iterator end) noexcept
-            {
-                // RFC-2781, 3.2 Byte order mark (BOM)
-                auto i = begin;
-                for (const auto b : utf8ByteOrderMark)
-                    if (i == end || static_cast<std::uint8_t>(*i++) != b)
-                        return false;
-                return true;
-            }
+        // The returned view is valid as long as the table
+        [[nodiscard]] std::string_view intern(const std::string_view name) { return *get(name); }
 
-            [[nodiscard]]
-            static constexpr bool isWhiteSpace(const char32_t c) noexcept
-            {
-                return c == ' ' || c == '\t' || c == '\r' || c == '\n';
-            }
+        [[nodiscard]] std::size_t size() const
+        {
+            if (!shared) return storage.size();
 
-            [[nodiscard]]
-            static constexpr bool isNameStartChar(const char32_t c) noexcept
-            {
-                return (c >= 'a' && c <= 'z') ||
-                    (c >= 'A' && c <= 'Z') ||
-                    c == ':' || c == '_' ||
-                    (c >= 0xC0 && c <= 0xD6) ||
-                    (c >= 0xD8 && c <= 0xF6) ||
-                    (c >= 0xF8 && c <= 0x2FF) ||
-                    (c >= 0x370 && c <= 0x37D) ||
-                    (c >= 0x37F && c <= 0x1FFF) ||
-                    (c >= 0x200C && c <= 0x200D) ||
-                    (c >= 0x2070 && c <= 0x218F) ||
-                    (c >= 0x2C00 && c <= 0x2FEF) ||
-                    (c >= 0x3001 && c <= 0xD7FF) ||
-                    (c >= 0xF900 && c <= 0xFDCF) ||
-                    (c >= 0xFDF0 && c <= 0xFFFD) ||
-                    (c >= 0x10000 && c <= 0xEFFFF);
-            }
+            const std::shared_lock lock{mutex};
+            return storage.size();
+        }
 
-            [[nodiscard]]
-            static constexpr bool isNameChar(const char32_t c) noexcept
-            {
-                return isNameStartChar(c) ||
-                    c == '-' || c == '.' ||
-                    (c >= '0' && c <= '9') ||
-                    c == 0xB7 ||
-                    (c >= 0x0300 && c <= 0x036F) ||
-                    (c >= 0x203F && c <= 0x2040);
-            }
+    private:
+        [[nodiscard]] const std::string* get(const std::string_view name)
+        {
+            if (!shared) return insert(name);
 
-            static void skipWhiteSpaces(std::u32string::const_iterator& iterator,
-                                        const std::u32string::const_iterator end)
             {
-                while (iterator != end && isWhiteSpace(*iterator))
-                    ++iterator;
+                // most names are already in the table, so look them up under a shared lock
+                const std::shared_lock lock{mutex};
+                if (const auto iterator = atoms.find(name); iterator != atoms.end())
+                    return iterator->second;
             }
 
-            static void expect(std::u32string::const_iterator& iterator,
-                               const std::u32string::const_iterator end,
-                               const char32_t c)
-            {
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+            const std::unique_lock lock{mutex};
+            return insert(name);
+        }
 
-                if (*iterator != c)
-                    throw ParseError{"Unexpected character"};
+        [[nodiscard]] const std::string* insert(const std::string_view name)
+        {
+            if (const auto iterator = atoms.find(name); iterator != atoms.end())
+                return iterator->second;
 
-                ++iterator;
-            }
+            const auto& atom = storage.emplace_back(name);
+            atoms.emplace(atom, &atom);
+            return &atom;
+        }
 
-            [[nodiscard]]
-            static std::string parseName(std::u32string::const_iterator& iterator,
-                                         const std::u32string::const_iterator end)
-            {
-                std::string result;
+        bool shared;
+        mutable std::shared_mutex mutex;
+        std::deque<std::string> storage; // elements of the deque never move
+        std::unordered_map<std::string_view, const std::string*> atoms;
+    };
 
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+    class FlatData;
 
-                if (!isNameStartChar(*iterator))
-                    throw ParseError{"Invalid name start"};
+    // Handle to a node of a FlatData, valid as long as the document is alive
+    class FlatNode final
+    {
+    public:
+        using Type = NodeBase::Type;
+        using ExternalIdType = NodeBase::ExternalIdType;
 
-                while (isNameChar(*iterator))
-                {
-                    result += fromUtf32(*iterator);
+        // Iterates over a node and its following siblings
+        class Iterator final
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = FlatNode;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = FlatNode;
 
-                    if (++iterator == end)
-                        throw ParseError{"Unexpected end of data"};
-                }
+            Iterator() noexcept = default;
+            Iterator(const FlatData* initDocument, const std::uint32_t initIndex) noexcept:
+                document{initDocument}, index{initIndex} {}
 
-                return result;
-            }
+            [[nodiscard]] FlatNode operator*() const noexcept { return FlatNode{*document, index}; }
 
-            [[nodiscard]]
-            static std::string parseReference(std::u32string::const_iterator& iterator,
-                                              const std::u32string::const_iterator end)
+            Iterator& operator++() noexcept;
+
+            Iterator operator++(int) noexcept
             {
-                std::string result;
+                const auto result = *this;
+                ++*this;
+                return result;
+            }
 
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+            [[nodiscard]] bool operator==(const Iterator& other) const noexcept { return index == other.index; }
+            [[nodiscard]] bool operator!=(const Iterator& other) const noexcept { return index != other.index; }
 
-                if (*iterator != '&')
-                    throw ParseError{"Expected an ampersand"};
+        private:
+            const FlatData* document = nullptr;
+            std::uint32_t index = std::numeric_limits<std::uint32_t>::max();
+        };
 
-                if (++iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+        // Iterates over the attributes of a node in document order
+        class AttributeIterator final
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<std::string_view, std::string_view>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
 
-                std::string value;
+            AttributeIterator() noexcept = default;
+            AttributeIterator(const FlatData* initDocument, const std::uint32_t initIndex) noexcept:
+                document{initDocument}, index{initIndex} {}
 
-                while (*iterator != ';')
-                {
-                    value += fromUtf32(*iterator);
+            [[nodiscard]] value_type operator*() const noexcept;
+
+            AttributeIterator& operator++() noexcept
+            {
+                ++index;
+                return *this;
+            }
+
+            AttributeIterator operator++(int) noexcept
+            {
+                const auto result = *this;
+                ++index;
+                return result;
+            }
+
+            [[nodiscard]] bool operator==(const AttributeIterator& other) const noexcept { return index == other.index; }
+            [[nodiscard]] bool operator!=(const AttributeIterator& other) const noexcept { return index != other.index; }
+
+        private:
+            const FlatData* document = nullptr;
+            std::uint32_t index = 0;
+        };
+
+        template <class IteratorType>
+        class Range final
+        {
+        public:
+            Range(const IteratorType initFirst, const IteratorType initLast) noexcept:
+                first{initFirst}, last{initLast} {}
+
+            [[nodiscard]] IteratorType begin() const noexcept { return first; }
+            [[nodiscard]] IteratorType end() const noexcept { return last; }
+            [[nodiscard]] bool empty() const noexcept { return first == last; }
+
+        private:
+            IteratorType first;
+            IteratorType last;
+        };
+
+        FlatNode(const FlatData& initDocument, const std::uint32_t initIndex) noexcept:
+            document{&initDocument}, index{initIndex} {}
+
+        [[nodiscard]] std::uint32_t getIndex() const noexcept { return index; }
+        [[nodiscard]] Type getType() const noexcept;
+        [[nodiscard]] ExternalIdType getExternalIdType() const noexcept;
+        [[nodiscard]] std::string_view getName() const noexcept;
+        [[nodiscard]] std::string_view getValue() const noexcept;
+
+        [[nodiscard]] bool hasParent() const noexcept;
+        [[nodiscard]] FlatNode getParent() const;
+
+        [[nodiscard]] Iterator begin() const noexcept;
+        [[nodiscard]] Iterator end() const noexcept { return Iterator{}; }
+        [[nodiscard]] Range<Iterator> getChildren() const noexcept { return {begin(), end()}; }
+
+        [[nodiscard]] Range<AttributeIterator> getAttributes() const noexcept;
+        [[nodiscard]] std::string_view operator[](const std::string_view attribute) const;
+
+    private:
+        const FlatData* document;
+        std::uint32_t index;
+    };
+
+    // Document that keeps all nodes in one array linked by indices, names in an AtomTable
+    // and all other strings in one pool
+    class FlatData final
+    {
+        friend FlatNode;
+        friend class detail::FlatBuilder;
+    public:
+        using value_type = FlatNode;
+
+        static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+
+        // The table can be shared by several documents, otherwise each document gets its own
+        explicit FlatData(std::shared_ptr<AtomTable> initAtoms = std::make_shared<AtomTable>()) noexcept:
+            atoms{std::move(initAtoms)}
+        {
+        }
+
+        // Names of the nodes and attributes are interned in this table,
+        // so a name interned in it can be compared with them by address
+        [[nodiscard]] AtomTable& getAtoms() const noexcept { return *atoms; }
+
+        [[nodiscard]] FlatNode::Iterator begin() const noexcept { return {this, firstChild}; }
+        [[nodiscard]] FlatNode::Iterator end() const noexcept { return {}; }
+        [[nodiscard]] FlatNode::Range<FlatNode::Iterator> getChildren() const noexcept { return {begin(), end()}; }
+
+        // Nodes are numbered in document order
+        [[nodiscard]] std::size_t size() const noexcept { return nodes.size(); }
+
+        [[nodiscard]] FlatNode operator[](const std::size_t index) const
+        {
+            if (index >= nodes.size())
+                throw RangeError{"Invalid node index"};
+
+            return FlatNode{*this, static_cast<std::uint32_t>(index)};
+        }
+
+    private:
+        // A string in the pool
+        struct Span final
+        {
+            std::uint32_t offset = 0;
+            std::uint32_t length = 0;
+        };
+
+        // Widest members first and the node kinds in one byte each, so there is no padding between them
+        struct Record final
+        {
+            const std::string* name = nullptr; // atom, nullptr for nodes without a name
+            Span value;
+            std::uint32_t parent = none;
+            std::uint32_t firstChild = none;
+            std::uint32_t nextSibling = none;
+            std::uint32_t firstAttribute = 0;
+            std::uint32_t attributeCount = 0;
+            std::uint8_t type = static_cast<std::uint8_t>(NodeBase::Type::tag);
+            std::uint8_t externalIdType = static_cast<std::uint8_t>(NodeBase::ExternalIdType::none);
+        };
+
+        static_assert(sizeof(Record) <= 40);
+
+        struct AttributeRecord final
+        {
+            const std::string* name;
+            Span value;
+        };
+
+        [[nodiscard]] std::string_view get(const Span span) const noexcept
+        {
+            return std::string_view(pool.data() + span.offset, span.length);
+        }
+
+        [[nodiscard]] static std::string_view get(const std::string* atom) noexcept
+        {
+            return atom ? std::string_view{*atom} : std::string_view{};
+        }
+
+        std::shared_ptr<AtomTable> atoms;
+        std::vector<Record> nodes;
+        std::vector<AttributeRecord> attributes;
+        std::string pool;
+        std::uint32_t firstChild = none;
+    };
+
+    inline FlatNode::Iterator& FlatNode::Iterator::operator++() noexcept
+    {
+        index = document->nodes[index].nextSibling;
+        return *this;
+    }
+
+    inline FlatNode::AttributeIterator::value_type FlatNode::AttributeIterator::operator*() const noexcept
+    {
+        const auto& attribute = document->attributes[index];
+        return {document->get(attribute.name), document->get(attribute.value)};
+    }
+
+    inline FlatNode::Type FlatNode::getType() const noexcept { return static_cast<Type>(document->nodes[index].type); }
+    inline FlatNode::ExternalIdType FlatNode::getExternalIdType() const noexcept { return static_cast<ExternalIdType>(document->nodes[index].externalIdType); }
+    inline std::string_view FlatNode::getName() const noexcept { return document->get(document->nodes[index].name); }
+    inline std::string_view FlatNode::getValue() const noexcept { return document->get(document->nodes[index].value); }
+
+    inline bool FlatNode::hasParent() const noexcept { return document->nodes[index].parent != FlatData::none; }
+
+    inline FlatNode FlatNode::getParent() const
+    {
+        if (const auto parent = document->nodes[index].parent; parent != FlatData::none)
+            return FlatNode{*document, parent};
+        else
+            throw RangeError{"Node has no parent"};
+    }
+
+    inline FlatNode::Iterator FlatNode::begin() const noexcept
+    {
+        return Iterator{document, document->nodes[index].firstChild};
+    }
+
+    inline FlatNode::Range<FlatNode::AttributeIterator> FlatNode::getAttributes() const noexcept
+    {
+        const auto& record = document->nodes[index];
+        return {AttributeIterator{document, record.firstAttribute},
+                AttributeIterator{document, record.firstAttribute + record.attributeCount}};
+    }
+
+    inline std::string_view FlatNode::operator[](const std::string_view attribute) const
+    {
+        for (const auto& [key, attributeValue] : getAttributes())
+            if (key == attribute) return attributeValue;
+
+        throw RangeError{"Invalid attribute"};
+    }
+
+    // Base for event handlers passed to parse; derived classes hide the callbacks they need.
+    // The views are valid only for the duration of the callback.
+    class Handler
+    {
+    public:
+        void startElement(std::string_view, const AttributesView&) {}
+        void endElement(std::string_view) {}
+        void text(std::string_view) {}
+        void characterData(std::string_view) {}
+        void comment(std::string_view) {}
+        void processingInstruction(std::string_view, std::string_view) {}
+        void startDocumentTypeDefinition(std::string_view, std::string_view) {}
+        void declaration(NodeBase::Type, std::string_view) {}
+        void endDocumentTypeDefinition() {}
+    };
+
+    // Set of absolute element paths, e.g. {"/feed/entry/id", "/feed/*/updated"}, to keep when parsing.
+    // Matching elements are kept with their whole subtree; elements matching the beginning of a path are kept
+    // with their attributes only, even if nothing below them matches. The rest of the document is checked
+    // for well-formedness without building any nodes.
+    class Projection final
+    {
+        template <class HandlerType> friend class detail::Projector;
+    public:
+        Projection(const std::initializer_list<std::string_view> initPaths)
+        {
+            for (const auto path : initPaths) add(path);
+        }
+
+        template <class Iterator>
+        Projection(const Iterator begin, const Iterator end)
+        {
+            for (auto i = begin; i != end; ++i) add(*i);
+        }
+
+        // Adds a path of element names separated by slashes, * matches any name
+        void add(const std::string_view path)
+        {
+            if (path.size() < 2 || path.front() != '/' || path.back() == '/')
+                throw ParseError{"Invalid path"};
+
+            std::vector<std::string> steps;
+            for (std::size_t position = 1; position <= path.size();)
+            {
+                const auto separator = std::min(path.find('/', position), path.size());
+                if (separator == position)
+                    throw ParseError{"Invalid path"};
+
+                steps.emplace_back(path.substr(position, separator - position));
+                position = separator + 1;
+            }
+
+            paths.push_back(std::move(steps));
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept { return paths.size(); }
+
+    private:
+        std::vector<std::vector<std::string>> paths;
+    };
+
+    // XPath 1.0 subset compiled once and evaluated against any number of documents:
+    // relative and absolute location paths with the child (/) and descendant (//) axes, name tests, *, text()
+    // and the predicates [n], [last()], [@name] and [@name='value']
+    class Query final
+    {
+    public:
+        explicit Query(const std::string_view expression)
+        {
+            auto iterator = expression.begin();
+            const auto end = expression.end();
+
+            if (iterator == end)
+                throw ParseError{"Invalid query"};
+
+            bool descendant = false;
+            if (*iterator == '/')
+            {
+                ++iterator;
+                if (iterator != end && *iterator == '/')
+                {
+                    ++iterator;
+                    descendant = true;
+                }
+            }
+
+            for (;;)
+            {
+                steps.push_back(parseStep(iterator, end, descendant));
+
+                if (iterator == end) break;
+
+                if (*iterator != '/')
+                    throw ParseError{"Invalid query"};
+                ++iterator;
+
+                descendant = iterator != end && *iterator == '/';
+                if (descendant) ++iterator;
+            }
+        }
+
+        // Returns the matching nodes in document order
+        template <class Allocator>
+        [[nodiscard]] std::vector<const BasicNode<Allocator>*> select(const BasicData<Allocator>& data) const
+        {
+            return evaluate<BasicNode<Allocator>>(data.getChildren());
+        }
+
+        // Returns the matching nodes in document order, starting from the children of node
+        template <class Allocator>
+        [[nodiscard]] std::vector<const BasicNode<Allocator>*> select(const BasicNode<Allocator>& node) const
+        {
+            return evaluate<BasicNode<Allocator>>(node.getChildren());
+        }
+
+    private:
+        struct Predicate final
+        {
+            enum class Kind
+            {
+                position,
+                last,
+                attribute,
+                attributeValue
+            };
+
+            Kind kind;
+            std::size_t position = 0;
+            std::string name;
+            std::string value;
+        };
+
+        struct Step final
+        {
+            enum class Test
+            {
+                name,
+                any,
+                text
+            };
+
+            bool descendant;
+            Test test;
+            std::string name;
+            std::vector<Predicate> predicates;
+        };
+
+        static bool isDelimiter(const char c) noexcept
+        {
+            return c == '/' || c == '[' || c == ']' || c == '=' || c == '@' ||
+                c == '\'' || c == '"' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        static void skipWhiteSpaces(std::string_view::const_iterator& iterator,
+                                    const std::string_view::const_iterator end) noexcept
+        {
+            while (iterator != end && (*iterator == ' ' || *iterator == '\t' || *iterator == '\n' || *iterator == '\r'))
+                ++iterator;
+        }
+
+        static std::string parseName(std::string_view::const_iterator& iterator,
+                                     const std::string_view::const_iterator end)
+        {
+            const auto begin = iterator;
+            while (iterator != end && !isDelimiter(*iterator)) ++iterator;
+
+            if (iterator == begin)
+                throw ParseError{"Invalid query"};
+
+            return std::string(begin, iterator);
+        }
+
+        static Step parseStep(std::string_view::const_iterator& iterator,
+                              const std::string_view::const_iterator end,
+                              const bool descendant)
+        {
+            Step step{descendant, Step::Test::name, parseName(iterator, end), {}};
+
+            if (step.name == "*")
+                step.test = Step::Test::any;
+            else if (step.name == "text()")
+                step.test = Step::Test::text;
+
+            while (iterator != end && *iterator == '[')
+            {
+                ++iterator;
+                skipWhiteSpaces(iterator, end);
+
+                step.predicates.push_back(parsePredicate(iterator, end));
+
+                skipWhiteSpaces(iterator, end);
+                if (iterator == end || *iterator != ']')
+                    throw ParseError{"Invalid query"};
+                ++iterator;
+            }
+
+            return step;
+        }
+
+        static Predicate parsePredicate(std::string_view::const_iterator& iterator,
+                                        const std::string_view::const_iterator end)
+        {
+            if (iterator == end)
+                throw ParseError{"Invalid query"};
+
+            Predicate predicate{Predicate::Kind::position, 0, {}, {}};
+
+            if (*iterator == '@')
+            {
+                ++iterator;
+                predicate.kind = Predicate::Kind::attribute;
+                predicate.name = parseName(iterator, end);
+
+                skipWhiteSpaces(iterator, end);
+                if (iterator != end && *iterator == '=')
+                {
+                    ++iterator;
+                    skipWhiteSpaces(iterator, end);
+
+                    if (iterator == end || (*iterator != '\'' && *iterator != '"'))
+                        throw ParseError{"Invalid query"};
+
+                    const auto quote = *iterator++;
+                    const auto begin = iterator;
+                    while (iterator != end && *iterator != quote) ++iterator;
+
+                    if (iterator == end)
+                        throw ParseError{"Invalid query"};
+
+                    predicate.kind = Predicate::Kind::attributeValue;
+                    predicate.value = std::string(begin, iterator++);
+                }
+            }
+            else if (*iterator >= '0' && *iterator <= '9')
+            {
+                for (; iterator != end && *iterator >= '0' && *iterator <= '9'; ++iterator)
+                    predicate.position = predicate.position * 10 + static_cast<std::size_t>(*iterator - '0');
+
+                if (predicate.position == 0)
+                    throw ParseError{"Invalid query"};
+            }
+            else if (parseName(iterator, end) == "last()")
+                predicate.kind = Predicate::Kind::last;
+            else
+                throw ParseError{"Invalid query"};
+
+            return predicate;
+        }
+
+        template <class NodeType>
+        static bool matches(const Step& step, const NodeType& node) noexcept
+        {
+            switch (step.test)
+            {
+                case Step::Test::name: return node.getType() == NodeBase::Type::tag && node.getName() == step.name;
+                case Step::Test::any: return node.getType() == NodeBase::Type::tag;
+                case Step::Test::text: return node.getType() == NodeBase::Type::text ||
+                    node.getType() == NodeBase::Type::characterData;
+            }
+
+            return false;
+        }
+
+        template <class NodeType>
+        static bool matches(const Predicate& predicate, const NodeType& node) noexcept
+        {
+            for (const auto& [key, value] : node.getAttributes())
+                if (key == predicate.name)
+                    return predicate.kind == Predicate::Kind::attribute || value == predicate.value;
+
+            return false;
+        }
+
+        // Applies the predicates of step to the nodes in result starting at first, which share a parent
+        template <class NodeType>
+        static void filter(const Step& step, std::vector<const NodeType*>& result, const std::size_t first)
+        {
+            for (const auto& predicate : step.predicates)
+            {
+                const auto count = result.size() - first;
+
+                if (predicate.kind == Predicate::Kind::position)
+                {
+                    if (predicate.position <= count)
+                        result[first] = result[first + predicate.position - 1];
+                    result.resize(first + (predicate.position <= count ? 1 : 0));
+                }
+                else if (predicate.kind == Predicate::Kind::last)
+                {
+                    if (count != 0) result[first] = result.back();
+                    result.resize(first + (count != 0 ? 1 : 0));
+                }
+                else
+                    result.erase(std::remove_if(result.begin() + static_cast<std::ptrdiff_t>(first), result.end(),
+                                                [&predicate](const NodeType* node) {
+                                                    return !matches(predicate, *node);
+                                                }), result.end());
+            }
+        }
+
+        // Appends the children (or descendants) of a node matching step to result
+        template <class NodeType, class Children>
+        static void apply(const Step& step, const Children& children, std::vector<const NodeType*>& result)
+        {
+            const auto first = result.size();
+            for (const auto& child : children)
+                if (matches(step, child)) result.push_back(&child);
+
+            filter(step, result, first);
+
+            if (step.descendant)
+            {
+                // interleave the matching children with the matches below them to keep document order
+                const std::vector<const NodeType*> selected(result.begin() + static_cast<std::ptrdiff_t>(first),
+                                                            result.end());
+                result.resize(first);
+
+                auto next = selected.begin();
+                for (const auto& child : children)
+                {
+                    if (next != selected.end() && *next == &child)
+                    {
+                        result.push_back(&child);
+                        ++next;
+                    }
+
+                    if (child.getType() == NodeBase::Type::tag)
+                        apply(step, child.getChildren(), result);
+                }
+            }
+        }
+
+        // Appends the nodes under children that are in selected to result in document order
+        template <class NodeType, class Children>
+        static void collect(const Children& children,
+                            const std::unordered_set<const NodeType*>& selected,
+                            std::vector<const NodeType*>& result)
+        {
+            for (const auto& child : children)
+            {
+                if (result.size() == selected.size()) return;
+
+                if (selected.find(&child) != selected.end()) result.push_back(&child);
+
+                if (child.getType() == NodeBase::Type::tag)
+                    collect(child.getChildren(), selected, result);
+            }
+        }
+
+        template <class NodeType, class Children>
+        std::vector<const NodeType*> evaluate(const Children& children) const
+        {
+            std::vector<const NodeType*> result;
+            apply(steps.front(), children, result);
+
+            // only a descendant step can select a node together with one of its ancestors
+            bool nested = steps.front().descendant;
+
+            std::vector<const NodeType*> next;
+            for (auto step = steps.begin() + 1; step != steps.end() && !result.empty(); ++step)
+            {
+                next.clear();
+                for (const auto node : result)
+                    apply(*step, node->getChildren(), next);
+
+                // nested context nodes reach the same descendants more than once, and the children of an outer
+                // context are appended after the matches below an inner one, so restore document order
+                if (nested && result.size() > 1 && next.size() > 1)
+                {
+                    const std::unordered_set<const NodeType*> selected(next.begin(), next.end());
+                    next.clear();
+                    collect(children, selected, next);
+                }
+
+                nested = nested || step->descendant;
+                std::swap(result, next);
+            }
+
+            return result;
+        }
+
+        std::vector<Step> steps;
+    };
+
+    // Lookup tables from ID attributes, and optionally from element names, to the elements of a document.
+    // The index refers to the nodes of the document by address, so any change to the document (adding,
+    // removing or moving nodes, changing names or attributes, destroying or reassigning it) invalidates
+    // the index; call rebuild before the next lookup.
+    template <class Allocator>
+    class BasicIndex final
+    {
+    public:
+        using Node = BasicNode<Allocator>;
+
+        explicit BasicIndex(const BasicData<Allocator>& data,
+                            const bool initIndexNames = false,
+                            const std::initializer_list<std::string_view> initIdAttributes = {"id", "xml:id"}):
+            idAttributes(initIdAttributes.begin(), initIdAttributes.end()),
+            indexNames{initIndexNames}
+        {
+            rebuild(data);
+        }
+
+        void rebuild(const BasicData<Allocator>& data)
+        {
+            ids.clear();
+            names.clear();
+
+            for (const auto& node : data)
+                add(node);
+        }
+
+        // Returns the first element in document order with the ID or nullptr
+        [[nodiscard]] const Node* getElementById(const std::string_view id) const
+        {
+            const auto i = ids.find(id);
+            return i != ids.end() ? i->second : nullptr;
+        }
+
+        // Returns the elements with the name in document order; throws if names are not indexed
+        [[nodiscard]] const std::vector<const Node*>& getElementsByTagName(const std::string_view name) const
+        {
+            if (!indexNames)
+                throw RangeError{"Names are not indexed"};
+
+            static const std::vector<const Node*> none;
+            const auto i = names.find(name);
+            return i != names.end() ? i->second : none;
+        }
+
+    private:
+        void add(const Node& node)
+        {
+            if (node.getType() != NodeBase::Type::tag) return;
+
+            for (const auto& [key, value] : node.getAttributes())
+                for (const auto& idAttribute : idAttributes)
+                    if (key == idAttribute)
+                        ids.emplace(std::string_view{value}, &node);
+
+            if (indexNames)
+                names[std::string_view{node.getName()}].push_back(&node);
+
+            for (const auto& child : node)
+                add(child);
+        }
+
+        std::vector<std::string> idAttributes;
+        bool indexNames;
+        // keys refer to the names and attribute values of the nodes
+        std::unordered_map<std::string_view, const Node*> ids;
+        std::unordered_map<std::string_view, std::vector<const Node*>> names;
+    };
+
+    using Index = BasicIndex<std::allocator<char>>;
+
+    inline namespace detail
+    {
+        constexpr std::array<std::uint8_t, 3> utf8ByteOrderMark = {0xEF, 0xBB, 0xBF};
+
+        template <class T, class = void>
+        struct IsContiguousByteRange: std::false_type {};
+
+        template <class T>
+        struct IsContiguousByteRange<T, std::void_t<decltype(std::data(std::declval<const T&>())),
+                                                    decltype(std::size(std::declval<const T&>()))>>:
+            std::bool_constant<sizeof(*std::data(std::declval<const T&>())) == 1> {};
+
+        [[nodiscard]]
+        inline unsigned countTrailingZeros(const std::uint64_t mask) noexcept
+        {
+#if defined(_MSC_VER)
+            unsigned long result;
+#  if defined(_M_X64) || defined(_M_ARM64)
+            _BitScanForward64(&result, mask);
+#  else
+            if (!_BitScanForward(&result, static_cast<unsigned long>(mask)))
+            {
+                _BitScanForward(&result, static_cast<unsigned long>(mask >> 32));
+                result += 32;
+            }
+#  endif
+            return static_cast<unsigned>(result);
+#else
+            return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+        }
+
+        // Thin wrapper over the widest available vector unit; each kernel
+        // builds a byte mask of matches and jumps to the lowest set bit
+        struct Simd final
+        {
+#if defined(XML_SIMD_AVX2)
+            using Register = __m256i;
+            static constexpr std::size_t width = 32;
+            static constexpr unsigned bitsPerByte = 1;
+
+            static Register load(const char* p) noexcept { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+            static Register broadcast(const char c) noexcept { return _mm256_set1_epi8(c); }
+            static Register equal(const Register a, const Register b) noexcept { return _mm256_cmpeq_epi8(a, b); }
+            static Register either(const Register a, const Register b) noexcept { return _mm256_or_si256(a, b); }
+            static Register both(const Register a, const Register b) noexcept { return _mm256_and_si256(a, b); }
+            static Register invert(const Register a) noexcept { return _mm256_xor_si256(a, _mm256_cmpeq_epi8(a, a)); }
+            static std::uint64_t mask(const Register a) noexcept { return static_cast<std::uint32_t>(_mm256_movemask_epi8(a)); }
+#elif defined(XML_SIMD_SSE2)
+            using Register = __m128i;
+            static constexpr std::size_t width = 16;
+            static constexpr unsigned bitsPerByte = 1;
+
+            static Register load(const char* p) noexcept { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+            static Register broadcast(const char c) noexcept { return _mm_set1_epi8(c); }
+            static Register equal(const Register a, const Register b) noexcept { return _mm_cmpeq_epi8(a, b); }
+            static Register either(const Register a, const Register b) noexcept { return _mm_or_si128(a, b); }
+            static Register both(const Register a, const Register b) noexcept { return _mm_and_si128(a, b); }
+            static Register invert(const Register a) noexcept { return _mm_xor_si128(a, _mm_cmpeq_epi8(a, a)); }
+            static std::uint64_t mask(const Register a) noexcept { return static_cast<std::uint32_t>(_mm_movemask_epi8(a)); }
+#elif defined(XML_SIMD_NEON)
+            using Register = uint8x16_t;
+            static constexpr std::size_t width = 16;
+            static constexpr unsigned bitsPerByte = 4;
+
+            static Register load(const char* p) noexcept { return vld1q_u8(reinterpret_cast<const std::uint8_t*>(p)); }
+            static Register broadcast(const char c) noexcept { return vdupq_n_u8(static_cast<std::uint8_t>(c)); }
+            static Register equal(const Register a, const Register b) noexcept { return vceqq_u8(a, b); }
+            static Register either(const Register a, const Register b) noexcept { return vorrq_u8(a, b); }
+            static Register both(const Register a, const Register b) noexcept { return vandq_u8(a, b); }
+            static Register invert(const Register a) noexcept { return vmvnq_u8(a); }
+            static std::uint64_t mask(const Register a) noexcept
+            {
+                // narrow each byte to a nibble, NEON has no movemask
+                return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(a), 4)), 0);
+            }
+#endif
+        };
+
+        template <class VectorMatch, class ScalarMatch>
+        [[nodiscard]]
+        const char* scan(const char* iterator, const char* end,
+                         [[maybe_unused]] const VectorMatch vectorMatch,
+                         const ScalarMatch scalarMatch) noexcept
+        {
+#if defined(XML_SIMD_AVX2) || defined(XML_SIMD_SSE2) || defined(XML_SIMD_NEON)
+            while (static_cast<std::size_t>(end - iterator) >= Simd::width)
+            {
+                if (const auto mask = Simd::mask(vectorMatch(Simd::load(iterator))); mask != 0)
+                    return iterator + countTrailingZeros(mask) / Simd::bitsPerByte;
+
+                iterator += Simd::width;
+            }
+#endif
+            while (iterator != end && !scalarMatch(*iterator))
+                ++iterator;
+
+            return iterator;
+        }
+
+        // Returns the first occurrence of c in [iterator, end) or end
+        [[nodiscard]]
+        inline const char* findAny(const char* iterator, const char* end, const char c) noexcept
+        {
+#if defined(XML_SIMD_AVX2) || defined(XML_SIMD_SSE2) || defined(XML_SIMD_NEON)
+            const auto vc = Simd::broadcast(c);
+            return scan(iterator, end,
+                        [vc](const auto chunk) noexcept { return Simd::equal(chunk, vc); },
+                        [c](const char b) noexcept { return b == c; });
+#else
+            return scan(iterator, end, nullptr,
+                        [c](const char b) noexcept { return b == c; });
+#endif
+        }
+
+        // Returns the first occurrence of c1 or c2 in [iterator, end) or end
+        [[nodiscard]]
+        inline const char* findAny(const char* iterator, const char* end, const char c1, const char c2) noexcept
+        {
+#if defined(XML_SIMD_AVX2) || defined(XML_SIMD_SSE2) || defined(XML_SIMD_NEON)
+            const auto v1 = Simd::broadcast(c1);
+            const auto v2 = Simd::broadcast(c2);
+            return scan(iterator, end,
+                        [v1, v2](const auto chunk) noexcept {
+                            return Simd::either(Simd::equal(chunk, v1), Simd::equal(chunk, v2));
+                        },
+                        [c1, c2](const char b) noexcept { return b == c1 || b == c2; });
+#else
+            return scan(iterator, end, nullptr,
+                        [c1, c2](const char b) noexcept { return b == c1 || b == c2; });
+#endif
+        }
+
+        // Returns the first byte in [iterator, end) that is not an XML white space or end
+        [[nodiscard]]
+        inline const char* findNonWhiteSpace(const char* iterator, const char* end) noexcept
+        {
+            const auto isNotWhiteSpace = [](const char b) noexcept {
+                return b != ' ' && b != '\t' && b != '\r' && b != '\n';
+            };
+
+            // most calls skip nothing or a single separator
+            if (iterator == end || isNotWhiteSpace(*iterator)) return iterator;
+            if (++iterator == end || isNotWhiteSpace(*iterator)) return iterator;
+
+#if defined(XML_SIMD_AVX2) || defined(XML_SIMD_SSE2) || defined(XML_SIMD_NEON)
+            const auto space = Simd::broadcast(' ');
+            const auto tab = Simd::broadcast('\t');
+            const auto carriageReturn = Simd::broadcast('\r');
+            const auto lineFeed = Simd::broadcast('\n');
+            return scan(iterator, end,
+                        [=](const auto chunk) noexcept {
+                            return Simd::invert(Simd::either(Simd::either(Simd::equal(chunk, space), Simd::equal(chunk, tab)),
+                                                             Simd::either(Simd::equal(chunk, carriageReturn), Simd::equal(chunk, lineFeed))));
+                        },
+                        isNotWhiteSpace);
+#else
+            return scan(iterator, end, nullptr, isNotWhiteSpace);
+#endif
+        }
+
+        // Returns the first byte in [iterator, end) that must be escaped in text and attribute values or end
+        [[nodiscard]]
+        inline const char* findEscaped(const char* iterator, const char* end) noexcept
+        {
+            const auto isEscaped = [](const char b) noexcept {
+                return b == '"' || b == '&' || b == '\'' || b == '<' || b == '>';
+            };
+
+#if defined(XML_SIMD_AVX2) || defined(XML_SIMD_SSE2) || defined(XML_SIMD_NEON)
+            const auto quote = Simd::broadcast('"');
+            const auto ampersand = Simd::broadcast('&');
+            const auto apostrophe = Simd::broadcast('\'');
+            const auto lessThan = Simd::broadcast('<');
+            const auto greaterThan = Simd::broadcast('>');
+            return scan(iterator, end,
+                        [=](const auto chunk) noexcept {
+                            return Simd::either(Simd::either(Simd::either(Simd::equal(chunk, quote), Simd::equal(chunk, ampersand)),
+                                                             Simd::either(Simd::equal(chunk, apostrophe), Simd::equal(chunk, lessThan))),
+                                                Simd::equal(chunk, greaterThan));
+                        },
+                        isEscaped);
+#else
+            return scan(iterator, end, nullptr, isEscaped);
+#endif
+        }
+
+        // Returns the first occurrence of the two-byte sequence c1 c2 in [iterator, end) or end
+        [[nodiscard]]
+        inline const char* findPair(const char* iterator, const char* end, const char c1, const char c2) noexcept
+        {
+            if (iterator == end) return end;
+
+#if defined(XML_SIMD_AVX2) || defined(XML_SIMD_SSE2) || defined(XML_SIMD_NEON)
+            const auto v1 = Simd::broadcast(c1);
+            const auto v2 = Simd::broadcast(c2);
+
+            // compare every position against c1 and the following position against c2
+            while (static_cast<std::size_t>(end - iterator) > Simd::width)
+            {
+                const auto match = Simd::both(Simd::equal(Simd::load(iterator), v1),
+                                              Simd::equal(Simd::load(iterator + 1), v2));
+                if (const auto mask = Simd::mask(match); mask != 0)
+                    return iterator + countTrailingZeros(mask) / Simd::bitsPerByte;
+
+                iterator += Simd::width;
+            }
+#endif
+            for (; iterator + 1 < end; ++iterator)
+                if (iterator[0] == c1 && iterator[1] == c2)
+                    return iterator;
+
+            return end;
+        }
+
+        // Returns the right angle bracket that ends the declaration at iterator, or end if there is none;
+        // like in findMarkupEnd, brackets inside literals and inside an internal subset do not count
+        [[nodiscard]]
+        inline const char* findDeclarationEnd(const char* iterator, const char* end) noexcept
+        {
+            bool internalSubset = false;
+            for (; iterator != end; ++iterator)
+            {
+                if (*iterator == '"' || *iterator == '\'')
+                {
+                    if ((iterator = findAny(iterator + 1, end, *iterator)) == end) break;
+                }
+                else if (internalSubset)
+                    internalSubset = *iterator != ']';
+                else if (*iterator == '[')
+                    internalSubset = true;
+                else if (*iterator == '>')
+                    return iterator;
+            }
+
+            return end;
+        }
+
+        // Where the scan of a truncated token stopped, so that it resumes there when more of the token arrives
+        struct ScanState final
+        {
+            std::size_t position = 0; // offset from the start of the token of the first byte not scanned yet
+            char quotes = '\0'; // quotes of the literal the scan stopped in
+            bool internalSubset = false; // the scan stopped in the internal subset of a document type definition
+        };
+
+        // Returns the end of the markup (tag, comment, character data, processing instruction or
+        // document type definition) starting with the left angle bracket at iterator, or nullptr if it is truncated;
+        // a truncated markup is scanned again only from where state says the previous scan stopped
+        [[nodiscard]]
+        inline const char* findMarkupEnd(const char* iterator, const char* end, ScanState& state) noexcept
+        {
+            const auto size = static_cast<std::size_t>(end - iterator);
+            if (size < 2) return nullptr;
+
+            const auto resume = [iterator, &state](const std::size_t minimum) noexcept {
+                return iterator + std::max(state.position, minimum);
+            };
+
+            // a terminator of two bytes followed by more may have its first bytes at the end of the data
+            const auto truncated = [size, &state](const std::size_t lookBehind) noexcept {
+                state.position = size > lookBehind ? size - lookBehind : 0;
+                return nullptr;
+            };
+
+            if (iterator[1] == '/')
+            {
+                const auto tokenEnd = findAny(resume(2), end, '>');
+                return tokenEnd == end ? truncated(0) : tokenEnd + 1;
+            }
+            else if (iterator[1] == '?')
+            {
+                const auto tokenEnd = findPair(resume(2), end, '?', '>');
+                return tokenEnd == end ? truncated(1) : tokenEnd + 2;
+            }
+            else if (iterator[1] == '!' && size < 4)
+                return nullptr;
+            else if (iterator[1] == '!' && iterator[2] == '-')
+            {
+                const auto tokenEnd = findPair(resume(4), end, '-', '-');
+                return end - tokenEnd < 3 ? truncated(2) : tokenEnd + 3;
+            }
+            else if (iterator[1] == '!' && iterator[2] == '[')
+            {
+                for (auto i = resume(3);; ++i)
+                {
+                    i = findPair(i, end, ']', ']');
+                    if (end - i < 3) return truncated(2);
+                    if (i[2] == '>') return i + 3;
+                }
+            }
+            else if (iterator[1] == '!')
+            {
+                // a document type definition ends after its internal subset, brackets inside literals do not count
+                for (auto i = resume(2); i != end; ++i)
+                {
+                    if (state.quotes != '\0' || *i == '"' || *i == '\'')
+                    {
+                        const auto quotes = state.quotes != '\0' ? state.quotes : *i;
+                        if ((i = findAny(state.quotes != '\0' ? i : i + 1, end, quotes)) == end)
+                        {
+                            state.quotes = quotes;
+                            break;
+                        }
+                        state.quotes = '\0';
+                    }
+                    else if (state.internalSubset)
+                        state.internalSubset = *i != ']';
+                    else if (*i == '[')
+                        state.internalSubset = true;
+                    else if (*i == '>')
+                        return i + 1;
+                }
+
+                return truncated(0);
+            }
+            else
+            {
+                // a start tag ends with the first right angle bracket outside of the attribute values
+                for (auto i = resume(1); i != end; ++i)
+                {
+                    if (state.quotes != '\0' || *i == '"' || *i == '\'')
+                    {
+                        const auto quotes = state.quotes != '\0' ? state.quotes : *i;
+                        if ((i = findAny(state.quotes != '\0' ? i : i + 1, end, quotes)) == end)
+                        {
+                            state.quotes = quotes;
+                            break;
+                        }
+                        state.quotes = '\0';
+                    }
+                    else if (*i == '>')
+                        return i + 1;
+                }
+
+                return truncated(0);
+            }
+        }
+
+        [[nodiscard]]
+        inline const char* findMarkupEnd(const char* iterator, const char* end) noexcept
+        {
+            ScanState state;
+            return findMarkupEnd(iterator, end, state);
+        }
+
+        class Parser final
+        {
+            friend class xml::Reader;
+            template <class HandlerType> friend class xml::PushParser;
+        public:
+            explicit Parser(const std::size_t initMaxDepth = defaultMaxDepth) noexcept:
+                maxDepth{initMaxDepth}
+            {
+            }
+
+            [[nodiscard]]
+            static char32_t toUtf32(const char* iterator, const char* end, std::size_t& length)
+            {
+                const auto byte = [](const char c) noexcept {
+                    return static_cast<char32_t>(static_cast<std::uint8_t>(c));
+                };
+
+                const auto lead = byte(*iterator);
+
+                if (lead <= 0x7F)
+                    length = 1;
+                else if ((lead >> 5) == 0x6)
+                    length = 2;
+                else if ((lead >> 4) == 0xE)
+                    length = 3;
+                else if ((lead >> 3) == 0x1E)
+                    length = 4;
+                else
+                    throw ParseError{"Invalid UTF-8 string"};
+
+                if (static_cast<std::size_t>(end - iterator) < length)
+                    throw ParseError{"Invalid UTF-8 string"};
+
+                switch (length)
+                {
+                    case 1: return lead;
+                    case 2: return ((lead & 0x1F) << 6) |
+                        (byte(iterator[1]) & 0x3F);
+                    case 3: return ((lead & 0x0F) << 12) |
+                        ((byte(iterator[1]) & 0x3F) << 6) |
+                        (byte(iterator[2]) & 0x3F);
+                    default: return ((lead & 0x07) << 18) |
+                        ((byte(iterator[1]) & 0x3F) << 12) |
+                        ((byte(iterator[2]) & 0x3F) << 6) |
+                        (byte(iterator[3]) & 0x3F);
+                }
+            }
+
+            static void fromUtf32(const char32_t c, std::string& result)
+            {
+                if (c <= 0x7F)
+                    result.push_back(static_cast<char>(c));
+                else if (c <= 0x7FF)
+                {
+                    result.push_back(static_cast<char>(0xC0 | ((c >> 6) & 0x1F)));
+                    result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+                }
+                else if (c <= 0xFFFF)
+                {
+                    result.push_back(static_cast<char>(0xE0 | ((c >> 12) & 0x0F)));
+                    result.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                    result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+                }
+                else
+                {
+                    result.push_back(static_cast<char>(0xF0 | ((c >> 18) & 0x07)));
+                    result.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                    result.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                    result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+                }
+            }
+
+            // Reports the document to handler as a sequence of events without building any nodes
+            template <class HandlerType, class WhiteSpaces, class Comments, class ProcessingInstructions>
+            void parse(const char* begin, const char* end,
+                       HandlerType& handler,
+                       const WhiteSpaces preserveWhiteSpaces,
+                       const Comments preserveComments,
+                       const ProcessingInstructions preserveProcessingInstructions)
+            {
+                auto iterator = hasByteOrderMark(begin, end) ? begin + utf8ByteOrderMark.size() : begin;
+                bool rootTagFound = false;
+                bool prologAllowed = true;
+                open.clear();
+
+                for (;;)
+                {
+                    if (!preserveWhiteSpaces) skipWhiteSpaces(iterator, end);
+
+                    if (iterator == end) break;
+
+                    const auto type = parse(iterator, end, handler,
+                                            preserveWhiteSpaces,
+                                            preserveComments,
+                                            preserveProcessingInstructions,
+                                            prologAllowed);
+
+                    if (type == NodeBase::Type::tag)
+                    {
+                        if (rootTagFound)
+                            throw ParseError{"Multiple root tags found"};
+                        else
+                            rootTagFound = true;
+                    }
+
+                    prologAllowed = false;
+                }
+
+                if (!rootTagFound)
+                    throw ParseError{"No root tag found"};
+            }
+
+            // Reports the nodes of the content of an element, given without its start and end tag
+            template <class HandlerType, class WhiteSpaces, class Comments, class ProcessingInstructions>
+            void parseFragment(const char* begin, const char* end,
+                               HandlerType& handler,
+                               const WhiteSpaces preserveWhiteSpaces,
+                               const Comments preserveComments,
+                               const ProcessingInstructions preserveProcessingInstructions)
+            {
+                auto iterator = begin;
+                open.clear();
+
+                for (;;)
+                {
+                    if (!preserveWhiteSpaces) skipWhiteSpaces(iterator, end);
+
+                    if (iterator == end) break;
+
+                    if (*iterator == '<' && iterator + 1 != end && *(iterator + 1) == '/')
+                        throw ParseError{"Unexpected end tag"};
+
+                    parse(iterator, end, handler,
+                          preserveWhiteSpaces,
+                          preserveComments,
+                          preserveProcessingInstructions,
+                          false);
+                }
+            }
+
+        private:
+            [[nodiscard]]
+            static bool hasByteOrderMark(const char* begin, const char* end) noexcept
+            {
+                // RFC-2781, 3.2 Byte order mark (BOM)
+                auto i = begin;
+                for (const auto b : utf8ByteOrderMark)
+                    if (i == end || static_cast<std::uint8_t>(*i++) != b)
+                        return false;
+                return true;
+            }
+
+            [[nodiscard]]
+            static constexpr bool isNameStartChar(const char32_t c) noexcept
+            {
+                return (c >= 'a' && c <= 'z') ||
+                    (c >= 'A' && c <= 'Z') ||
+                    c == ':' || c == '_' ||
+                    (c >= 0xC0 && c <= 0xD6) ||
+                    (c >= 0xD8 && c <= 0xF6) ||
+                    (c >= 0xF8 && c <= 0x2FF) ||
+                    (c >= 0x370 && c <= 0x37D) ||
+                    (c >= 0x37F && c <= 0x1FFF) ||
+                    (c >= 0x200C && c <= 0x200D) ||
+                    (c >= 0x2070 && c <= 0x218F) ||
+                    (c >= 0x2C00 && c <= 0x2FEF) ||
+                    (c >= 0x3001 && c <= 0xD7FF) ||
+                    (c >= 0xF900 && c <= 0xFDCF) ||
+                    (c >= 0xFDF0 && c <= 0xFFFD) ||
+                    (c >= 0x10000 && c <= 0xEFFFF);
+            }
+
+            [[nodiscard]]
+            static constexpr bool isNameChar(const char32_t c) noexcept
+            {
+                return isNameStartChar(c) ||
+                    c == '-' || c == '.' ||
+                    (c >= '0' && c <= '9') ||
+                    c == 0xB7 ||
+                    (c >= 0x0300 && c <= 0x036F) ||
+                    (c >= 0x203F && c <= 0x2040);
+            }
+
+            static void skipWhiteSpaces(const char*& iterator, const char* end) noexcept
+            {
+                iterator = findNonWhiteSpace(iterator, end);
+            }
+
+            static void expect(const char*& iterator, const char* end, const char c)
+            {
+                if (iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                if (*iterator != c)
+                    throw ParseError{"Unexpected character"};
+
+                ++iterator;
+            }
+
+            [[nodiscard]]
+            static std::string_view parseName(const char*& iterator, const char* end)
+            {
+                if (iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                const auto begin = iterator;
+                std::size_t length = 0;
+
+                if (!isNameStartChar(toUtf32(iterator, end, length)))
+                    throw ParseError{"Invalid name start"};
+
+                for (;;)
+                {
+                    if ((iterator += length) == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                    // ASCII name characters are classified without decoding
+                    const auto c = static_cast<std::uint8_t>(*iterator);
+                    if (c <= 0x7F)
+                    {
+                        if (!isNameChar(c)) break;
+                        length = 1;
+                    }
+                    else if (!isNameChar(toUtf32(iterator, end, length)))
+                        break;
+                }
+
+                return std::string_view(begin, static_cast<std::size_t>(iterator - begin));
+            }
+
+            static void parseReference(const char*& iterator, const char* end,
+                                       std::string& result)
+            {
+                if (iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                if (*iterator != '&')
+                    throw ParseError{"Expected an ampersand"};
+
+                if (++iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                const auto begin = iterator;
+
+                while (*iterator != ';')
+                    if (++iterator == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                const std::string_view value(begin, static_cast<std::size_t>(iterator - begin));
+
+                ++iterator;
+
+                if (value.empty())
+                    throw ParseError{"Invalid entity"};
+
+                if (value[0] == '#') // char reference
+                {
+                    if (value.length() < 2)
+                        throw ParseError{"Invalid entity"};
+
+                    char32_t c = 0;
+
+                    if (value[1] == 'x') // hex value
+                    {
+                        if (value.length() < 3)
+                            throw ParseError{"Invalid entity"};
+
+                        for (std::size_t i = 2; i < value.length(); ++i)
+                        {
+                            std::uint8_t code = 0;
+
+                            if (value[i] >= '0' && value[i] <= '9')
+                                code = static_cast<std::uint8_t>(value[i]) - '0';
+                            else if (value[i] >= 'a' && value[i] <='f')
+                                code = static_cast<std::uint8_t>(value[i]) - 'a' + 10;
+                            else if (value[i] >= 'A' && value[i] <='F')
+                                code = static_cast<std::uint8_t>(value[i]) - 'A' + 10;
+                            else
+                                throw ParseError{"Invalid character code"};
+
+                            c = (c << 4) | code;
+                        }
+                    }
+                    else
+                    {
+                        for (std::size_t i = 1; i < value.length(); ++i)
+                        {
+                            const std::uint8_t code = (value[i] >= '0' && value[i] <= '9') ?
+                                static_cast<std::uint8_t>(value[i]) - '0' :
+                                throw ParseError{"Invalid character code"};
+
+                            c = c * 10 + code;
+                        }
+                    }
+
+                    fromUtf32(c, result);
+                }
+                else // entity reference
+                {
+                    if (value == "quot")
+                        result.push_back('"');
+                    else if (value == "amp")
+                        result.push_back('&');
+                    else if (value == "apos")
+                        result.push_back('\'');
+                    else if (value == "lt")
+                        result.push_back('<');
+                    else if (value == "gt")
+                        result.push_back('>');
+                    else
+                        throw ParseError{"Invalid entity"};
+                }
+            }
+
+            // Returns a view of the input, or of decoded if the value contains references
+            [[nodiscard]]
+            static std::string_view parseString(const char*& iterator, const char* end,
+                                                std::string& decoded)
+            {
+                if (iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                if (*iterator != '"' && *iterator != '\'')
+                    throw ParseError{"Expected quotes"};
+
+                const auto quotes = *iterator;
+
+                if (++iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                const auto begin = iterator;
+                if ((iterator = findAny(iterator, end, quotes, '&')) == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                if (*iterator == quotes)
+                    return std::string_view(begin, static_cast<std::size_t>(iterator++ - begin));
+
+                decoded.assign(begin, iterator);
+
+                for (;;)
+                {
+                    parseReference(iterator, end, decoded);
+
+                    const auto runBegin = iterator;
+                    if ((iterator = findAny(iterator, end, quotes, '&')) == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                    decoded.append(runBegin, iterator);
+
+                    if (*iterator == quotes) break;
+                }
+
+                ++iterator;
+
+                return decoded;
+            }
+
+            template <class HandlerType>
+            static void parseDtdElement(const char*& iterator, const char* end,
+                                        HandlerType& handler)
+            {
+                expect(iterator, end, '<');
+                expect(iterator, end, '!');
+
+                if (iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                NodeBase::Type type = NodeBase::Type::tag;
+
+                if (const auto keyword = parseName(iterator, end); keyword == "ELEMENT")
+                    type = NodeBase::Type::element;
+                else if (keyword == "ATTLIST")
+                    type = NodeBase::Type::attributeList;
+                else if (keyword == "ENTITY")
+                    type = NodeBase::Type::entity;
+                else if (keyword == "NOTATION")
+                    type = NodeBase::Type::notation;
+
+                skipWhiteSpaces(iterator, end);
+
+                const auto name = parseName(iterator, end);
+
+                if ((iterator = findDeclarationEnd(iterator, end)) == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                ++iterator;
+
+                handler.declaration(type, name);
+            }
+
+            template <class HandlerType, class WhiteSpaces, class Comments, class ProcessingInstructions>
+            NodeBase::Type parseElement(const char*& iterator, const char* end,
+                                        HandlerType& handler,
+                                        const WhiteSpaces preserveWhiteSpaces,
+                                        const Comments preserveComments,
+                                        const ProcessingInstructions preserveProcessingInstructions,
+                                        const bool prologAllowed)
+            {
+                expect(iterator, end, '<');
+
+                if (iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                if (*iterator == '!') // <!
+                {
+                    if (++iterator == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                    if (*iterator == '-') // <!-
+                    {
+                        ++iterator;
+
+                        expect(iterator, end, '-'); // <!--
+
+                        const auto begin = iterator;
+                        iterator = findPair(iterator, end, '-', '-'); // --
+
+                        if (end - iterator < 3)
+                            throw ParseError{"Unexpected end of data"};
+
+                        if (*(iterator + 2) != '>') // -->
+                            throw ParseError{"Unexpected double-hyphen inside comment"};
+
+                        const std::string_view value(begin, static_cast<std::size_t>(iterator - begin));
+                        iterator += 3;
+
+                        if (preserveComments) handler.comment(value);
+
+                        return NodeBase::Type::comment;
+                    }
+                    else if (*iterator == '[') // <![
+                    {
+                        ++iterator;
+                        if (const auto name = parseName(iterator, end); name != "CDATA")
+                            throw ParseError{"Expected CDATA"};
+
+                        if (iterator == end)
+                            throw ParseError{"Unexpected end of data"};
+
+                        expect(iterator, end, '[');
+
+                        const auto begin = iterator;
+                        for (;;)
+                        {
+                            iterator = findPair(iterator, end, ']', ']');
+
+                            if (end - iterator < 3)
+                                throw ParseError{"Unexpected end of data"};
+
+                            if (*(iterator + 2) == '>') // ]]>
+                                break;
+
+                            ++iterator;
+                        }
+
+                        const std::string_view value(begin, static_cast<std::size_t>(iterator - begin));
+                        iterator += 3;
+
+                        handler.characterData(value);
+
+                        return NodeBase::Type::characterData;
+                    }
+                    else // <!
+                    {
+                        if (const auto type = parseName(iterator, end); type != "DOCTYPE")
+                            throw ParseError{"Invalid document type declaration"};
+
+                        skipWhiteSpaces(iterator, end);
+
+                        const auto name = parseName(iterator, end);
+
+                        skipWhiteSpaces(iterator, end);
+
+                        if (iterator == end)
+                            throw ParseError{"Unexpected end of data"};
+
+                        if (*iterator == '[')
+                        {
+                            if (++iterator == end)
+                                throw ParseError{"Unexpected end of data"};
+
+                            handler.startDocumentTypeDefinition(name, std::string_view{});
+
+                            skipWhiteSpaces(iterator, end);
+
+                            if (iterator == end)
+                                throw ParseError{"Unexpected end of data"};
+
+                            while (*iterator != ']')
+                            {
+                                parseDtdElement(iterator, end, handler);
+
+                                skipWhiteSpaces(iterator, end);
+
+                                if (iterator == end)
+                                    throw ParseError{"Unexpected end of data"};
+                            }
+
+                            ++iterator;
+                        }
+                        else
+                        {
+                            const auto begin = iterator;
+                            if ((iterator = findDeclarationEnd(iterator, end)) == end)
+                                throw ParseError{"Unexpected end of data"};
+
+                            handler.startDocumentTypeDefinition(name, std::string_view(begin, static_cast<std::size_t>(iterator - begin)));
+                        }
+
+                        skipWhiteSpaces(iterator, end);
+
+                        if (iterator == end)
+                            throw ParseError{"Unexpected end of data"};
+
+                        if (*iterator != '>')
+                            throw ParseError{"Expected a right angle bracket"};
+
+                        ++iterator;
+
+                        handler.endDocumentTypeDefinition();
+
+                        return NodeBase::Type::documentTypeDefinition;
+                    }
+                }
+                else if (*iterator == '?') // <?
+                {
+                    ++iterator;
+
+                    const auto name = parseName(iterator, end);
+                    if (!prologAllowed && name.length() == 3 &&
+                        std::tolower(name[0]) == 'x' &&
+                        std::tolower(name[1]) == 'm' &&
+                        std::tolower(name[2]) == 'l')
+                    {
+                        throw ParseError{"Invalid processing instruction"};
+                    }
+
+                    skipWhiteSpaces(iterator, end);
+
+                    if (iterator == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                    const auto begin = iterator;
+
+                    if ((iterator = findAny(iterator, end, '?')) == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                    const std::string_view value(begin, static_cast<std::size_t>(iterator - begin));
 
                     if (++iterator == end)
                         throw ParseError{"Unexpected end of data"};
+
+                    expect(iterator, end, '>');
+
+                    if (preserveProcessingInstructions) handler.processingInstruction(name, value);
+
+                    return NodeBase::Type::processingInstruction;
+                }
+                else // <
+                {
+                    const auto [name, empty] = parseStartTag(iterator, end);
+
+                    handler.startElement(name, std::as_const(attributes));
+
+                    if (!empty)
+                        parseContent(iterator, end, handler, name,
+                                     preserveWhiteSpaces,
+                                     preserveComments,
+                                     preserveProcessingInstructions);
+
+                    handler.endElement(name);
+
+                    return NodeBase::Type::tag;
+                }
+            }
+
+            // Parses the name and the attributes of a start tag following the left angle bracket,
+            // returns true for an empty-element tag (<name/>)
+            [[nodiscard]]
+            std::pair<std::string_view, bool> parseStartTag(const char*& iterator, const char* end)
+            {
+                const auto name = parseName(iterator, end);
+
+                attributes.clear();
+                auto decoded = attributeValues.begin();
+
+                for (;;)
+                {
+                    skipWhiteSpaces(iterator, end);
+
+                    if (iterator == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                    if (*iterator == '>')
+                    {
+                        ++iterator;
+                        checkUniqueAttributes();
+                        return {name, false};
+                    }
+                    else if (*iterator == '/')
+                    {
+                        ++iterator;
+
+                        expect(iterator, end, '>');
+
+                        checkUniqueAttributes();
+                        return {name, true};
+                    }
+
+                    const auto attribute = parseName(iterator, end);
+
+                    skipWhiteSpaces(iterator, end);
+
+                    expect(iterator, end, '=');
+
+                    skipWhiteSpaces(iterator, end);
+
+                    std::string_view value = parseString(iterator, end, buffer);
+                    if (value.data() == buffer.data()) // the scratch buffer is reused by the next value
+                    {
+                        if (decoded == attributeValues.end()) decoded = attributeValues.emplace(decoded);
+                        value = *decoded++ = buffer;
+                    }
+
+                    attributes.emplace_back(attribute, value);
+                }
+            }
+
+            // Throws if a name appears twice among the attributes of the start tag (XML 1.0, 3.1 Unique Att Spec);
+            // the few attributes of a typical element are compared directly, long lists go through a hash set
+            void checkUniqueAttributes()
+            {
+                constexpr std::size_t maxDirectComparison = 16;
+
+                if (attributes.size() <= maxDirectComparison)
+                {
+                    for (auto i = attributes.begin(); i != attributes.end(); ++i)
+                        for (auto j = attributes.begin(); j != i; ++j)
+                            if (i->first == j->first)
+                                throw ParseError{"Duplicate attribute"};
+                }
+                else
+                {
+                    attributeNames.clear();
+                    for (const auto& attribute : attributes)
+                        if (!attributeNames.insert(attribute.first).second)
+                            throw ParseError{"Duplicate attribute"};
+                }
+            }
+
+            // Parses the children of the element name up to and including its end tag,
+            // keeping the open elements on an explicit stack instead of recursing;
+            // outerDepth is the number of open elements around name that are not on the stack
+            template <class HandlerType, class WhiteSpaces, class Comments, class ProcessingInstructions>
+            void parseContent(const char*& iterator, const char* end,
+                              HandlerType& handler,
+                              const std::string_view name,
+                              const WhiteSpaces preserveWhiteSpaces,
+                              const Comments preserveComments,
+                              const ProcessingInstructions preserveProcessingInstructions,
+                              const std::size_t outerDepth = 0)
+            {
+                const auto depth = open.size();
+                open.push_back(name);
+
+                while (open.size() > depth)
+                {
+                    if (!preserveWhiteSpaces) skipWhiteSpaces(iterator, end);
+
+                    if (iterator == end)
+                        throw ParseError{"Unexpected end of data"};
+
+                    if (*iterator != '<')
+                        handler.text(parseText(iterator, end));
+                    else if (iterator + 1 != end && *(iterator + 1) == '/')
+                    {
+                        iterator += 2; // skip the left angle bracket and the slash
+
+                        const auto tag = open.back();
+                        parseEndTag(iterator, end, tag);
+                        open.pop_back();
+
+                        // the end of name is reported by the caller
+                        if (open.size() > depth) handler.endElement(tag);
+                    }
+                    else if (iterator + 1 != end && (*(iterator + 1) == '!' || *(iterator + 1) == '?'))
+                        parseElement(iterator, end, handler,
+                                     preserveWhiteSpaces,
+                                     preserveComments,
+                                     preserveProcessingInstructions,
+                                     false);
+                    else
+                    {
+                        ++iterator; // skip the left angle bracket
+
+                        const auto [tag, empty] = parseStartTag(iterator, end);
+                        checkDepth(outerDepth + open.size());
+
+                        handler.startElement(tag, std::as_const(attributes));
+
+                        if (empty)
+                            handler.endElement(tag);
+                        else
+                            open.push_back(tag);
+                    }
+                }
+            }
+
+            // Throws if an element inside depth open elements would be nested too deeply
+            void checkDepth(const std::size_t depth) const
+            {
+                if (depth >= maxDepth)
+                    throw ParseError{"Maximum depth exceeded"};
+            }
+
+            // Parses the rest of an end tag following "</"
+            static void parseEndTag(const char*& iterator, const char* end,
+                                    const std::string_view name)
+            {
+                if (const auto tag = parseName(iterator, end); tag != name)
+                    throw ParseError{"Tag not closed properly"};
+
+                expect(iterator, end, '>');
+            }
+
+            // Returns a view of the input, or of the scratch buffer if the text contains references
+            [[nodiscard]]
+            std::string_view parseText(const char*& iterator, const char* end)
+            {
+                const auto begin = iterator;
+                iterator = findAny(iterator, end, '<', '&');
+
+                if (iterator == end || *iterator == '<')
+                    return std::string_view(begin, static_cast<std::size_t>(iterator - begin));
+
+                buffer.assign(begin, iterator);
+
+                for (;;)
+                {
+                    parseReference(iterator, end, buffer);
+
+                    const auto runBegin = iterator;
+                    iterator = findAny(iterator, end, '<', '&');
+
+                    buffer.append(runBegin, iterator);
+
+                    if (iterator == end || // end of a file
+                        *iterator == '<') // start of a tag
+                        break;
+                }
+
+                return buffer;
+            }
+
+            template <class HandlerType, class WhiteSpaces, class Comments, class ProcessingInstructions>
+            NodeBase::Type parse(const char*& iterator, const char* end,
+                                 HandlerType& handler,
+                                 const WhiteSpaces preserveWhiteSpaces,
+                                 const Comments preserveComments,
+                                 const ProcessingInstructions preserveProcessingInstructions,
+                                 const bool prologAllowed)
+            {
+
+                if (iterator == end)
+                    throw ParseError{"Unexpected end of data"};
+
+                if (*iterator == '<')
+                    return parseElement(iterator, end, handler,
+                                        preserveWhiteSpaces,
+                                        preserveComments,
+                                        preserveProcessingInstructions,
+                                        prologAllowed);
+
+                handler.text(parseText(iterator, end));
+
+                return NodeBase::Type::text;
+            }
+
+            std::size_t maxDepth;
+            std::vector<std::string_view> open; // names of the elements whose end tag has not been reached yet
+            std::string buffer; // decoded text
+            AttributesView attributes; // attributes of the current start tag
+            std::unordered_set<std::string_view> attributeNames; // for finding duplicates in long attribute lists
+            std::list<std::string> attributeValues; // decoded attribute values, nodes of the list never move
+        };
+
+        // Handler that assembles the events into a BasicData or DataView document
+        template <class Document>
+        class Builder final
+        {
+        public:
+            using NodeType = typename Document::value_type;
+
+            Builder(Document& initDocument, const char* initBegin, const char* initEnd) noexcept:
+                document{initDocument}, begin{initBegin}, end{initEnd}
+            {
+            }
+
+            void startElement(const std::string_view name, const AttributesView& attributes)
+            {
+                auto node = makeNode(NodeType::Type::tag);
+                node.setName(intern(name));
+
+                for (const auto& [key, value] : attributes)
+                    setAttribute(node, intern(key), keep(value));
+
+                open.push_back(std::move(node));
+            }
+
+            void endElement(std::string_view)
+            {
+                close();
+            }
+
+            void text(const std::string_view value)
+            {
+                append(makeNode(keep(value)));
+            }
+
+            void characterData(const std::string_view value)
+            {
+                append(makeNode(NodeType::Type::characterData, value));
+            }
+
+            void comment(const std::string_view value)
+            {
+                append(makeNode(NodeType::Type::comment, value));
+            }
+
+            void processingInstruction(const std::string_view name, const std::string_view value)
+            {
+                append(makeNode(NodeType::Type::processingInstruction, value, name));
+            }
+
+            void startDocumentTypeDefinition(const std::string_view name, const std::string_view value)
+            {
+                open.push_back(makeNode(NodeType::Type::documentTypeDefinition, value, name));
+            }
+
+            void declaration(const NodeBase::Type type, const std::string_view name)
+            {
+                append(makeNode(type, std::string_view{}, name));
+            }
+
+            void endDocumentTypeDefinition()
+            {
+                close();
+            }
+
+        private:
+            template <class... Args>
+            [[nodiscard]] NodeType makeNode(Args&&... args) const
+            {
+                if constexpr (std::is_same_v<Document, DataView>)
+                    return NodeType(std::forward<Args>(args)...);
+                else
+                    return NodeType(std::forward<Args>(args)..., document.get_allocator());
+            }
+
+            [[nodiscard]] NodeType makeNode(const NodeBase::Type type,
+                                            const std::string_view value,
+                                            const std::string_view name = std::string_view{}) const
+            {
+                auto node = makeNode(type);
+                node.setName(intern(name));
+                node.setValue(value);
+                return node;
+            }
+
+            // names are views into the atom table of a DataView that has one
+            [[nodiscard]] std::string_view intern(const std::string_view name) const
+            {
+                if constexpr (std::is_same_v<Document, DataView>)
+                    return document.atoms && !name.empty() ? document.atoms->intern(name) : name;
+                else
+                    return name;
+            }
+
+            // views into the input are kept by DataView, decoded values are copied into it
+            [[nodiscard]] std::string_view keep(const std::string_view value)
+            {
+                if constexpr (std::is_same_v<Document, DataView>)
+                {
+                    const std::less<const char*> less;
+                    return less(value.data(), begin) || less(end, value.data() + value.size()) ?
+                        document.store(value) : value;
+                }
+                else
+                    return value;
+            }
+
+            static void setAttribute(NodeType& node,
+                                     const std::string_view name,
+                                     const std::string_view value)
+            {
+                // the parser has rejected duplicate names, so the attributes are appended without a lookup
+                if constexpr (std::is_same_v<Document, DataView>)
+                    node.attributes.emplace_back(name, value);
+                else
+                {
+                    using String = typename NodeType::String;
+                    const auto allocator = node.get_allocator();
+                    node.attributes.emplace_back(String{name, allocator}, String{value, allocator});
+                }
+            }
+
+            void append(NodeType&& node)
+            {
+                if (open.empty())
+                    document.pushBack(std::move(node));
+                else
+                    open.back().pushBack(std::move(node));
+            }
+
+            void close()
+            {
+                auto node = std::move(open.back());
+                open.pop_back();
+                append(std::move(node));
+            }
+
+            Document& document;
+            const char* begin;
+            const char* end;
+            std::vector<NodeType> open; // elements whose end tag has not been reached yet
+        };
+
+        // Handler that appends the events to a FlatData in document order
+        class FlatBuilder final
+        {
+        public:
+            explicit FlatBuilder(FlatData& initDocument):
+                document{initDocument}, last(1, FlatData::none)
+            {
+            }
+
+            void startElement(const std::string_view name, const AttributesView& attributes)
+            {
+                const auto index = add(NodeBase::Type::tag, name, std::string_view{});
+
+                auto& record = document.nodes[index];
+                record.firstAttribute = static_cast<std::uint32_t>(document.attributes.size());
+                record.attributeCount = static_cast<std::uint32_t>(attributes.size());
+
+                for (const auto& [key, value] : attributes)
+                    document.attributes.push_back({document.atoms->get(key), store(value)});
+
+                open(index);
+            }
+
+            void endElement(std::string_view) { close(); }
+            void text(const std::string_view value) { add(NodeBase::Type::text, std::string_view{}, value); }
+            void characterData(const std::string_view value) { add(NodeBase::Type::characterData, std::string_view{}, value); }
+            void comment(const std::string_view value) { add(NodeBase::Type::comment, std::string_view{}, value); }
+
+            void processingInstruction(const std::string_view name, const std::string_view value)
+            {
+                add(NodeBase::Type::processingInstruction, name, value);
+            }
+
+            void startDocumentTypeDefinition(const std::string_view name, const std::string_view value)
+            {
+                open(add(NodeBase::Type::documentTypeDefinition, name, value));
+            }
+
+            void declaration(const NodeBase::Type type, const std::string_view name)
+            {
+                add(type, name, std::string_view{});
+            }
+
+            void endDocumentTypeDefinition() { close(); }
+
+        private:
+            [[nodiscard]] FlatData::Span store(const std::string_view value)
+            {
+                if (document.pool.size() + value.size() > FlatData::none)
+                    throw RangeError{"Document too large"};
+
+                const FlatData::Span span{static_cast<std::uint32_t>(document.pool.size()),
+                                          static_cast<std::uint32_t>(value.size())};
+                document.pool.append(value);
+                return span;
+            }
+
+            std::uint32_t add(const NodeBase::Type type,
+                              const std::string_view name,
+                              const std::string_view value)
+            {
+                if (document.nodes.size() >= FlatData::none)
+                    throw RangeError{"Document too large"};
+
+                const auto index = static_cast<std::uint32_t>(document.nodes.size());
+
+                FlatData::Record record;
+                record.type = static_cast<std::uint8_t>(type);
+                record.parent = parents.empty() ? FlatData::none : parents.back();
+                if (!name.empty()) record.name = document.atoms->get(name);
+                record.value = store(value);
+                document.nodes.push_back(record);
+
+                // link the node after the previous child of its parent
+                if (const auto previous = last.back(); previous != FlatData::none)
+                    document.nodes[previous].nextSibling = index;
+                else if (parents.empty())
+                    document.firstChild = index;
+                else
+                    document.nodes[parents.back()].firstChild = index;
+
+                last.back() = index;
+
+                return index;
+            }
+
+            void open(const std::uint32_t index)
+            {
+                parents.push_back(index);
+                last.push_back(FlatData::none);
+            }
+
+            void close()
+            {
+                parents.pop_back();
+                last.pop_back();
+            }
+
+            FlatData& document;
+            std::vector<std::uint32_t> parents; // open elements
+            std::vector<std::uint32_t> last; // last child on each level, starting with the top level
+        };
+
+        // Handler that passes to handler only the events of the elements selected by a Projection
+        template <class HandlerType>
+        class Projector final
+        {
+        public:
+            Projector(HandlerType& initHandler, const Projection& initProjection):
+                handler{initHandler}, projection{initProjection}
+            {
+                for (std::size_t i = 0; i < projection.paths.size(); ++i)
+                    candidates.push_back(i);
+                levels.push_back(0);
+            }
+
+            void startElement(const std::string_view name, const AttributesView& attributes)
+            {
+                if (skipped) ++skipped;
+                else if (selected)
+                {
+                    ++selected;
+                    handler.startElement(name, attributes);
+                }
+                else
+                {
+                    // paths that continue below this element
+                    const auto depth = levels.size() - 1;
+                    const auto first = levels.back();
+                    const auto last = candidates.size();
+                    bool matched = false;
+                    for (auto i = first; i != last; ++i)
+                    {
+                        const auto& steps = projection.paths[candidates[i]];
+                        if (steps[depth] == "*" || steps[depth] == name)
+                        {
+                            if (steps.size() == depth + 1) matched = true;
+                            else candidates.push_back(candidates[i]);
+                        }
+                    }
+
+                    if (matched)
+                    {
+                        candidates.resize(last);
+                        selected = 1;
+                        handler.startElement(name, attributes);
+                    }
+                    else if (candidates.size() != last)
+                    {
+                        levels.push_back(last);
+                        handler.startElement(name, attributes);
+                    }
+                    else
+                        skipped = 1;
+                }
+            }
+
+            void endElement(const std::string_view name)
+            {
+                if (skipped) --skipped;
+                else
+                {
+                    if (selected) --selected;
+                    else
+                    {
+                        candidates.resize(levels.back());
+                        levels.pop_back();
+                    }
+                    handler.endElement(name);
+                }
+            }
+
+            void text(const std::string_view value)
+            {
+                if (selected) handler.text(value);
+            }
+
+            void characterData(const std::string_view value)
+            {
+                if (selected) handler.characterData(value);
+            }
+
+            void comment(const std::string_view value)
+            {
+                if (selected || outside()) handler.comment(value);
+            }
+
+            void processingInstruction(const std::string_view name, const std::string_view value)
+            {
+                if (selected || outside()) handler.processingInstruction(name, value);
+            }
+
+            void startDocumentTypeDefinition(const std::string_view name, const std::string_view value)
+            {
+                handler.startDocumentTypeDefinition(name, value);
+            }
+
+            void declaration(const NodeBase::Type type, const std::string_view name)
+            {
+                handler.declaration(type, name);
+            }
+
+            void endDocumentTypeDefinition()
+            {
+                handler.endDocumentTypeDefinition();
+            }
+
+        private:
+            // true before and after the root element
+            bool outside() const noexcept
+            {
+                return !skipped && levels.size() == 1;
+            }
+
+            HandlerType& handler;
+            const Projection& projection;
+            std::vector<std::size_t> candidates; // indices of the paths matching the open elements, by level
+            std::vector<std::size_t> levels; // offset of the candidates of each level
+            std::size_t selected = 0; // depth inside a selected element
+            std::size_t skipped = 0; // depth inside a discarded element
+        };
+
+        // Calls function with the input as a contiguous range of chars, copying it only if necessary
+        template <class Iterator, class Function>
+        void withBytes(const Iterator begin, const Iterator end, const Function& function)
+        {
+            if constexpr (std::is_pointer_v<Iterator> && sizeof(*std::declval<Iterator>()) == 1)
+            {
+                // contiguous bytes are parsed in place
+                function(reinterpret_cast<const char*>(begin),
+                         reinterpret_cast<const char*>(end));
+            }
+            else
+            {
+                std::string buffer;
+                for (auto i = begin; i != end; ++i)
+                    buffer.push_back(static_cast<char>(*i));
+
+                function(buffer.data(), buffer.data() + buffer.size());
+            }
+        }
+
+        template <class T, class Function>
+        void withBytes(const T& data, const Function& function)
+        {
+            if constexpr (IsContiguousByteRange<T>::value)
+            {
+                const auto begin = std::data(data);
+                withBytes(begin, begin + std::size(data), function);
+            }
+            else
+            {
+                using std::begin, std::end; // add std::begin and std::end to lookup
+                withBytes(begin(data), end(data), function);
+            }
+        }
+
+        // std::true_type if flag is in flags, passed to the parser in place of a bool so that the tests fold away
+        template <Flags flags, Flags flag>
+        using FlagSet = std::bool_constant<(flags & flag) == flag>;
+
+        template <class Document, class WhiteSpaces, class Comments, class ProcessingInstructions>
+        void parseDocument(const char* begin, const char* end,
+                           Document& result,
+                           const WhiteSpaces preserveWhiteSpaces,
+                           const Comments preserveComments,
+                           const ProcessingInstructions preserveProcessingInstructions,
+                           const std::size_t maxDepth)
+        {
+            Builder<Document> builder{result, begin, end};
+            Parser{maxDepth}.parse(begin, end, builder,
+                                   preserveWhiteSpaces,
+                                   preserveComments,
+                                   preserveProcessingInstructions);
+        }
+
+        // Parts of a document parsed in parallel are at least this large
+        constexpr std::size_t minimumPartSize = 64 * 1024;
+
+        // Content of the root element and the start tags of the children of the root at which it is split
+        struct ContentSplit final
+        {
+            const char* contentBegin = nullptr;
+            const char* contentEnd = nullptr;
+            std::vector<const char*> boundaries;
+        };
+
+        // Scans only the markup of the document and splits the content of the root element into up to parts ranges
+        // of about the same size; returns false if the markup is malformed or the content cannot be split
+        inline bool splitContent(const char* begin, const char* end, const std::size_t parts, ContentSplit& split)
+        {
+            const auto partSize = static_cast<std::size_t>(end - begin) / parts;
+            std::size_t depth = 0;
+
+            for (auto iterator = findAny(begin, end, '<'); iterator != end; iterator = findAny(iterator, end, '<'))
+            {
+                // comments, character data and attribute values are skipped as a whole, so a split never falls inside them
+                const auto markupEnd = findMarkupEnd(iterator, end);
+                if (markupEnd == nullptr) return false;
+
+                if (iterator[1] == '/')
+                {
+                    if (depth == 0) return false;
+
+                    if (--depth == 0)
+                    {
+                        split.contentEnd = iterator;
+                        return !split.boundaries.empty();
+                    }
+                }
+                else if (iterator[1] != '!' && iterator[1] != '?')
+                {
+                    const auto empty = markupEnd[-2] == '/';
+
+                    if (depth == 0)
+                    {
+                        if (empty) return false;
+                        split.contentBegin = markupEnd;
+                    }
+                    else if (depth == 1 && split.boundaries.size() + 1 < parts)
+                    {
+                        const auto partBegin = split.boundaries.empty() ? split.contentBegin : split.boundaries.back();
+                        if (static_cast<std::size_t>(iterator - partBegin) >= partSize)
+                            split.boundaries.push_back(iterator);
+                    }
+
+                    if (!empty) ++depth;
+                }
+
+                iterator = markupEnd;
+            }
+
+            return false;
+        }
+
+        // Parses the parts of the content of the root element on separate threads and moves their nodes into the
+        // root element; returns false if the document has to be parsed sequentially
+        inline bool parseParts(const char* begin, const char* end,
+                               Data& result,
+                               const std::size_t threads,
+                               const bool preserveWhiteSpaces,
+                               const bool preserveComments,
+                               const bool preserveProcessingInstructions,
+                               const std::size_t maxDepth)
+        {
+            const auto parts = std::min(threads, static_cast<std::size_t>(end - begin) / minimumPartSize);
+
+            ContentSplit split;
+            if (parts < 2 || maxDepth < 2 || !splitContent(begin, end, parts, split))
+                return false;
+
+            std::vector<const char*> bounds{split.contentBegin};
+            bounds.insert(bounds.end(), split.boundaries.begin(), split.boundaries.end());
+            bounds.push_back(split.contentEnd);
+
+            const auto count = bounds.size() - 1;
+            std::vector<Data> fragments(count);
+            std::vector<std::exception_ptr> errors(count);
+
+            const auto parsePart = [&](const std::size_t i) noexcept {
+                try
+                {
+                    // the children of the root are one level deeper than the top of the fragment
+                    Builder<Data> builder{fragments[i], bounds[i], bounds[i + 1]};
+                    Parser{maxDepth - 1}.parseFragment(bounds[i], bounds[i + 1], builder,
+                                                       preserveWhiteSpaces,
+                                                       preserveComments,
+                                                       preserveProcessingInstructions);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            };
+
+            std::vector<std::thread> workers;
+            try
+            {
+                for (std::size_t i = 1; i < count; ++i)
+                    workers.emplace_back(parsePart, i);
+            }
+            catch (...)
+            {
+                for (auto& worker : workers) worker.join();
+                return false;
+            }
+
+            parsePart(0);
+            for (auto& worker : workers) worker.join();
+
+            for (const auto& error : errors)
+                if (error) return false;
+
+            // the prolog, the root element without its content and the epilog
+            std::string skeleton(begin, split.contentBegin);
+            skeleton.append(split.contentEnd, end);
+
+            try
+            {
+                parseDocument(skeleton.data(), skeleton.data() + skeleton.size(), result,
+                              preserveWhiteSpaces,
+                              preserveComments,
+                              preserveProcessingInstructions,
+                              maxDepth);
+            }
+            catch (const ParseError&)
+            {
+                return false;
+            }
+
+            const auto root = std::find_if(result.begin(), result.end(), [](const Node& node) noexcept {
+                return node.getType() == NodeBase::Type::tag;
+            });
+
+            for (auto& fragment : fragments)
+                for (auto& node : fragment)
+                    root->pushBack(std::move(node));
+
+            return true;
+        }
+    }
+
+    template <class Iterator>
+    Data parse(const Iterator begin, const Iterator end,
+               bool preserveWhiteSpaces = false,
+               bool preserveComments = false,
+               bool preserveProcessingInstructions = false,
+               const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Data result;
+        withBytes(begin, end, [&](const char* first, const char* last) {
+            parseDocument(first, last, result,
+                          preserveWhiteSpaces,
+                          preserveComments,
+                          preserveProcessingInstructions,
+                          maxDepth);
+        });
+        return result;
+    }
+
+    [[nodiscard]]
+    inline Data parse(const char* data,
+                      const bool preserveWhiteSpaces = false,
+                      const bool preserveComments = false,
+                      const bool preserveProcessingInstructions = false,
+                      const std::size_t maxDepth = defaultMaxDepth)
+    {
+        return parse(data, data + std::strlen(data),
+                     preserveWhiteSpaces,
+                     preserveComments,
+                     preserveProcessingInstructions,
+                     maxDepth);
+    }
+
+    template <class T>
+    [[nodiscard]]
+    Data parse(const T& data,
+               const bool preserveWhiteSpaces = false,
+               const bool preserveComments = false,
+               const bool preserveProcessingInstructions = false,
+               const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Data result;
+        withBytes(data, [&](const char* first, const char* last) {
+            parseDocument(first, last, result,
+                          preserveWhiteSpaces,
+                          preserveComments,
+                          preserveProcessingInstructions,
+                          maxDepth);
+        });
+        return result;
+    }
+
+#if defined(__cpp_lib_memory_resource)
+    // Every node, string and attribute of the returned document is allocated from resource
+    [[nodiscard]]
+    inline pmr::Data parse(const char* data,
+                           std::pmr::memory_resource* resource,
+                           const bool preserveWhiteSpaces = false,
+                           const bool preserveComments = false,
+                           const bool preserveProcessingInstructions = false,
+                           const std::size_t maxDepth = defaultMaxDepth)
+    {
+        pmr::Data result{resource};
+        parseDocument(data, data + std::strlen(data), result,
+                      preserveWhiteSpaces,
+                      preserveComments,
+                      preserveProcessingInstructions,
+                      maxDepth);
+        return result;
+    }
+
+    // Every node, string and attribute of the returned document is allocated from resource
+    template <class T>
+    [[nodiscard]]
+    pmr::Data parse(const T& data,
+                    std::pmr::memory_resource* resource,
+                    const bool preserveWhiteSpaces = false,
+                    const bool preserveComments = false,
+                    const bool preserveProcessingInstructions = false,
+                    const std::size_t maxDepth = defaultMaxDepth)
+    {
+        pmr::Data result{resource};
+        withBytes(data, [&](const char* first, const char* last) {
+            parseDocument(first, last, result,
+                          preserveWhiteSpaces,
+                          preserveComments,
+                          preserveProcessingInstructions,
+                          maxDepth);
+        });
+        return result;
+    }
+#endif
+
+    // The returned document refers to data, which must outlive it
+    [[nodiscard]]
+    inline DataView parseView(const std::string_view data,
+                              const bool preserveWhiteSpaces = false,
+                              const bool preserveComments = false,
+                              const bool preserveProcessingInstructions = false,
+                              const std::size_t maxDepth = defaultMaxDepth)
+    {
+        DataView result;
+        parseDocument(data.data(), data.data() + data.size(), result,
+                      preserveWhiteSpaces,
+                      preserveComments,
+                      preserveProcessingInstructions,
+                      maxDepth);
+        return result;
+    }
+
+    // Like parseView, but the element and attribute names are interned in atoms, which the document keeps alive,
+    // so equal names are views of the same characters and can be compared by address
+    [[nodiscard]]
+    inline DataView parseView(const std::string_view data,
+                              std::shared_ptr<AtomTable> atoms,
+                              const bool preserveWhiteSpaces = false,
+                              const bool preserveComments = false,
+                              const bool preserveProcessingInstructions = false,
+                              const std::size_t maxDepth = defaultMaxDepth)
+    {
+        DataView result{std::move(atoms)};
+        parseDocument(data.data(), data.data() + data.size(), result,
+                      preserveWhiteSpaces,
+                      preserveComments,
+                      preserveProcessingInstructions,
+                      maxDepth);
+        return result;
+    }
+
+    // Parses into a FlatData, whose nodes are stored in one array in document order
+    // and whose names are interned in atoms
+    template <class T>
+    [[nodiscard]]
+    FlatData parseFlat(const T& data,
+                       std::shared_ptr<AtomTable> atoms,
+                       const bool preserveWhiteSpaces = false,
+                       const bool preserveComments = false,
+                       const bool preserveProcessingInstructions = false,
+                       const std::size_t maxDepth = defaultMaxDepth)
+    {
+        FlatData result{std::move(atoms)};
+        FlatBuilder builder{result};
+        withBytes(data, [&](const char* first, const char* last) {
+            Parser{maxDepth}.parse(first, last, builder,
+                                   preserveWhiteSpaces,
+                                   preserveComments,
+                                   preserveProcessingInstructions);
+        });
+        return result;
+    }
+
+    // Parses into a FlatData with its own atom table
+    template <class T>
+    [[nodiscard]]
+    FlatData parseFlat(const T& data,
+                       const bool preserveWhiteSpaces = false,
+                       const bool preserveComments = false,
+                       const bool preserveProcessingInstructions = false,
+                       const std::size_t maxDepth = defaultMaxDepth)
+    {
+        return parseFlat(data, std::make_shared<AtomTable>(),
+                         preserveWhiteSpaces,
+                         preserveComments,
+                         preserveProcessingInstructions,
+                         maxDepth);
+    }
+
+    [[nodiscard]]
+    inline FlatData parseFlat(const char* data,
+                              const bool preserveWhiteSpaces = false,
+                              const bool preserveComments = false,
+                              const bool preserveProcessingInstructions = false,
+                              const std::size_t maxDepth = defaultMaxDepth)
+    {
+        return parseFlat(std::string_view{data},
+                         preserveWhiteSpaces,
+                         preserveComments,
+                         preserveProcessingInstructions,
+                         maxDepth);
+    }
+
+    // Reports the document to handler, which derives from Handler, without building any nodes
+    template <class HandlerType, std::enable_if_t<std::is_base_of_v<Handler, HandlerType>>* = nullptr>
+    void parse(const char* data,
+               HandlerType& handler,
+               const bool preserveWhiteSpaces = false,
+               const bool preserveComments = false,
+               const bool preserveProcessingInstructions = false,
+               const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Parser{maxDepth}.parse(data, data + std::strlen(data), handler,
+                               preserveWhiteSpaces,
+                               preserveComments,
+                               preserveProcessingInstructions);
+    }
+
+    // Reports the document to handler, which derives from Handler, without building any nodes
+    template <class T, class HandlerType, std::enable_if_t<std::is_base_of_v<Handler, HandlerType>>* = nullptr>
+    void parse(const T& data,
+               HandlerType& handler,
+               const bool preserveWhiteSpaces = false,
+               const bool preserveComments = false,
+               const bool preserveProcessingInstructions = false,
+               const std::size_t maxDepth = defaultMaxDepth)
+    {
+        withBytes(data, [&](const char* first, const char* last) {
+            Parser{maxDepth}.parse(first, last, handler,
+                                   preserveWhiteSpaces,
+                                   preserveComments,
+                                   preserveProcessingInstructions);
+        });
+    }
+
+    // Parses the children of the root element on up to threads threads and joins them into one document.
+    // A document that is small, cannot be split between the children of its root or fails to parse is parsed
+    // sequentially, so the result and the errors are the same as those of parse.
+    template <class T>
+    [[nodiscard]]
+    Data parseParallel(const T& data,
+                       const std::size_t threads = std::thread::hardware_concurrency(),
+                       const bool preserveWhiteSpaces = false,
+                       const bool preserveComments = false,
+                       const bool preserveProcessingInstructions = false,
+                       const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Data result;
+        withBytes(data, [&](const char* first, const char* last) {
+            if (!parseParts(first, last, result, threads,
+                            preserveWhiteSpaces,
+                            preserveComments,
+                            preserveProcessingInstructions,
+                            maxDepth))
+            {
+                result = Data{};
+                parseDocument(first, last, result,
+                              preserveWhiteSpaces,
+                              preserveComments,
+                              preserveProcessingInstructions,
+                              maxDepth);
+            }
+        });
+        return result;
+    }
+
+    [[nodiscard]]
+    inline Data parseParallel(const char* data,
+                              const std::size_t threads = std::thread::hardware_concurrency(),
+                              const bool preserveWhiteSpaces = false,
+                              const bool preserveComments = false,
+                              const bool preserveProcessingInstructions = false,
+                              const std::size_t maxDepth = defaultMaxDepth)
+    {
+        return parseParallel(std::string_view{data}, threads,
+                             preserveWhiteSpaces,
+                             preserveComments,
+                             preserveProcessingInstructions,
+                             maxDepth);
+    }
+
+    // Outcome of parsing one input of a batch
+    struct BatchItem final
+    {
+        Data data;
+        std::exception_ptr error; // set if the input could not be parsed
+        std::chrono::nanoseconds latency{};
+    };
+
+    struct BatchResult final
+    {
+        std::vector<BatchItem> items; // in the order of the inputs
+        std::size_t bytes = 0;
+        std::chrono::nanoseconds elapsed{};
+
+        // Bytes parsed per second of wall-clock time
+        [[nodiscard]] double getThroughput() const noexcept
+        {
+            return elapsed.count() > 0 ?
+                static_cast<double>(bytes) * 1e9 / static_cast<double>(elapsed.count()) : 0.0;
+        }
+    };
+
+    inline namespace detail
+    {
+        // Inputs of one worker of a batch; the owner takes them from the front, other workers steal from the back
+        struct BatchQueue final
+        {
+            std::mutex mutex;
+            std::size_t next = 0;
+            std::size_t end = 0;
+        };
+    }
+
+    // Parses batches of many independent documents, e.g. strings or string views, on up to threads threads.
+    // The worker threads and their parsers with the scratch buffers are created once and kept for all
+    // batches, so a caller that parses batch after batch does not start threads for each of them.
+    // The thread that calls parse takes part in the work; one batch can be parsed at a time.
+    class BatchParser final
+    {
+    public:
+        explicit BatchParser(const std::size_t threads = std::thread::hardware_concurrency(),
+                             const bool initPreserveWhiteSpaces = false,
+                             const bool initPreserveComments = false,
+                             const bool initPreserveProcessingInstructions = false,
+                             const std::size_t maxDepth = defaultMaxDepth):
+            preserveWhiteSpaces{initPreserveWhiteSpaces},
+            preserveComments{initPreserveComments},
+            preserveProcessingInstructions{initPreserveProcessingInstructions}
+        {
+            const auto threadCount = std::max(std::size_t{1}, threads);
+
+            parsers.assign(threadCount, Parser{maxDepth});
+            queues = std::vector<BatchQueue>(threadCount);
+
+            // reserved before any thread is started, so that only starting a thread can fail below
+            workers.reserve(threadCount - 1);
+            try
+            {
+                for (std::size_t i = 1; i < threadCount; ++i)
+                    workers.emplace_back(&BatchParser::run, this, i);
+            }
+            catch (...)
+            {
+                // the batches are shared between the workers that could be started
+            }
+
+            parsers.resize(workers.size() + 1, Parser{maxDepth});
+        }
+
+        ~BatchParser()
+        {
+            {
+                std::lock_guard lock{mutex};
+                stopping = true;
+            }
+            wake.notify_all();
+
+            for (auto& worker : workers) worker.join();
+        }
+
+        BatchParser(const BatchParser&) = delete;
+        BatchParser& operator=(const BatchParser&) = delete;
+
+        // Number of threads that parse a batch, including the calling one
+        [[nodiscard]] std::size_t getThreadCount() const noexcept { return parsers.size(); }
+
+        // Each worker takes its share of the inputs and steals half of the remaining inputs of another
+        // worker when it runs out. An input that fails to parse gets its exception in the result
+        // instead of stopping the batch.
+        template <class Inputs>
+        [[nodiscard]]
+        BatchResult parse(const Inputs& inputs)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const auto count = static_cast<std::size_t>(std::size(inputs));
+            const auto workerCount = std::max(std::size_t{1}, std::min(parsers.size(), count));
+
+            BatchResult result;
+            result.items.resize(count);
+
+            for (std::size_t i = 0; i < workerCount; ++i)
+            {
+                queues[i].next = count * i / workerCount;
+                queues[i].end = count * (i + 1) / workerCount;
+            }
+
+            std::vector<std::size_t> bytes(workerCount);
+
+            const std::function<void(std::size_t)> work = [&](const std::size_t worker) noexcept {
+                if (worker >= workerCount) return;
+
+                auto& parser = parsers[worker];
+
+                for (std::size_t index; take(worker, workerCount, index);)
+                {
+                    auto& item = result.items[index];
+                    const auto begin = std::chrono::steady_clock::now();
+
+                    try
+                    {
+                        withBytes(inputs[index], [&](const char* first, const char* last) {
+                            bytes[worker] += static_cast<std::size_t>(last - first);
+
+                            Builder<Data> builder{item.data, first, last};
+                            parser.parse(first, last, builder,
+                                         preserveWhiteSpaces,
+                                         preserveComments,
+                                         preserveProcessingInstructions);
+                        });
+                    }
+                    catch (...)
+                    {
+                        item.data = Data{};
+                        item.error = std::current_exception();
+                    }
+
+                    item.latency = std::chrono::steady_clock::now() - begin;
+                }
+            };
+
+            if (workerCount > 1)
+            {
+                {
+                    std::lock_guard lock{mutex};
+                    job = &work;
+                    running = workers.size();
+                    ++generation;
+                }
+                wake.notify_all();
+            }
+
+            work(0);
+
+            if (workerCount > 1)
+            {
+                std::unique_lock lock{mutex};
+                done.wait(lock, [this]() noexcept { return running == 0; });
+                job = nullptr;
+            }
+
+            for (const auto workerBytes : bytes) result.bytes += workerBytes;
+            result.elapsed = std::chrono::steady_clock::now() - start;
+            return result;
+        }
+
+    private:
+        // Waits for the batches and parses its share of each of them
+        void run(const std::size_t worker) noexcept
+        {
+            std::size_t seen = 0;
+
+            for (;;)
+            {
+                std::unique_lock lock{mutex};
+                wake.wait(lock, [this, seen]() noexcept { return stopping || generation != seen; });
+                if (stopping) return;
+
+                seen = generation;
+                const auto& current = *job;
+                lock.unlock();
+
+                current(worker);
+
+                lock.lock();
+                if (--running == 0) done.notify_one();
+            }
+        }
+
+        bool take(const std::size_t worker, const std::size_t workerCount, std::size_t& index)
+        {
+            auto& own = queues[worker];
+            {
+                std::lock_guard lock{own.mutex};
+                if (own.next != own.end)
+                {
+                    index = own.next++;
+                    return true;
+                }
+            }
+
+            for (std::size_t i = 1; i < workerCount; ++i)
+            {
+                auto& victim = queues[(worker + i) % workerCount];
+                std::size_t first;
+                std::size_t last;
+                {
+                    std::lock_guard lock{victim.mutex};
+                    if (victim.next == victim.end) continue;
+
+                    last = victim.end;
+                    victim.end -= (victim.end - victim.next + 1) / 2;
+                    first = victim.end;
+                }
+
+                index = first;
+
+                std::lock_guard lock{own.mutex};
+                own.next = first + 1;
+                own.end = last;
+                return true;
+            }
+
+            return false;
+        }
+
+        bool preserveWhiteSpaces;
+        bool preserveComments;
+        bool preserveProcessingInstructions;
+        std::vector<Parser> parsers; // one for each worker, the first one for the calling thread
+        std::vector<BatchQueue> queues;
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable wake; // a batch has started or the parser is being destroyed
+        std::condition_variable done; // every worker has finished its share of the batch
+        const std::function<void(std::size_t)>* job = nullptr;
+        std::size_t generation = 0;
+        std::size_t running = 0;
+        bool stopping = false;
+    };
+
+    // Parses many independent documents on up to threads threads once. This starts and joins the
+    // worker threads and creates their parsers on every call; a caller that parses batch after
+    // batch should keep a BatchParser instead.
+    template <class Inputs>
+    [[nodiscard]]
+    BatchResult parseBatch(const Inputs& inputs,
+                           const std::size_t threads = std::thread::hardware_concurrency(),
+                           const bool preserveWhiteSpaces = false,
+                           const bool preserveComments = false,
+                           const bool preserveProcessingInstructions = false,
+                           const std::size_t maxDepth = defaultMaxDepth)
+    {
+        return BatchParser{std::min(threads, static_cast<std::size_t>(std::size(inputs))),
+                           preserveWhiteSpaces,
+                           preserveComments,
+                           preserveProcessingInstructions,
+                           maxDepth}.parse(inputs);
+    }
+
+    // Builds only the elements selected by projection
+    template <class T>
+    [[nodiscard]]
+    Data parse(const T& data,
+               const Projection& projection,
+               const bool preserveWhiteSpaces = false,
+               const bool preserveComments = false,
+               const bool preserveProcessingInstructions = false,
+               const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Data result;
+        withBytes(data, [&](const char* first, const char* last) {
+            Builder<Data> builder{result, first, last};
+            Projector<Builder<Data>> projector{builder, projection};
+            Parser{maxDepth}.parse(first, last, projector,
+                                   preserveWhiteSpaces,
+                                   preserveComments,
+                                   preserveProcessingInstructions);
+        });
+        return result;
+    }
+
+    // Builds only the elements selected by projection
+    [[nodiscard]]
+    inline Data parse(const char* data,
+                      const Projection& projection,
+                      const bool preserveWhiteSpaces = false,
+                      const bool preserveComments = false,
+                      const bool preserveProcessingInstructions = false,
+                      const std::size_t maxDepth = defaultMaxDepth)
+    {
+        return parse(std::string_view{data}, projection,
+                     preserveWhiteSpaces,
+                     preserveComments,
+                     preserveProcessingInstructions,
+                     maxDepth);
+    }
+
+    template <Flags flags, class T>
+    [[nodiscard]]
+    Data parse(const T& data, const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Data result;
+        withBytes(data, [&](const char* first, const char* last) {
+            parseDocument(first, last, result,
+                          FlagSet<flags, Flags::preserveWhiteSpaces>{},
+                          FlagSet<flags, Flags::preserveComments>{},
+                          FlagSet<flags, Flags::preserveProcessingInstructions>{},
+                          maxDepth);
+        });
+        return result;
+    }
+
+    template <Flags flags>
+    [[nodiscard]]
+    Data parse(const char* data, const std::size_t maxDepth = defaultMaxDepth)
+    {
+        return parse<flags>(std::string_view{data}, maxDepth);
+    }
+
+    template <Flags flags>
+    [[nodiscard]]
+    DataView parseView(const std::string_view data, const std::size_t maxDepth = defaultMaxDepth)
+    {
+        DataView result;
+        parseDocument(data.data(), data.data() + data.size(), result,
+                      FlagSet<flags, Flags::preserveWhiteSpaces>{},
+                      FlagSet<flags, Flags::preserveComments>{},
+                      FlagSet<flags, Flags::preserveProcessingInstructions>{},
+                      maxDepth);
+        return result;
+    }
+
+    template <Flags flags, class HandlerType, std::enable_if_t<std::is_base_of_v<Handler, HandlerType>>* = nullptr>
+    void parse(const std::string_view data, HandlerType& handler, const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Parser{maxDepth}.parse(data.data(), data.data() + data.size(), handler,
+                               FlagSet<flags, Flags::preserveWhiteSpaces>{},
+                               FlagSet<flags, Flags::preserveComments>{},
+                               FlagSet<flags, Flags::preserveProcessingInstructions>{});
+    }
+
+    // Pull parser that reads one token per call to next(); the input must outlive the reader.
+    // Names, values and attributes are valid until the next call to next() or skipSubtree().
+    class Reader final
+    {
+    public:
+        enum class Token
+        {
+            none,
+            startElement,
+            endElement,
+            text,
+            characterData,
+            comment,
+            processingInstruction,
+            documentTypeDefinition,
+            end
+        };
+
+        explicit Reader(const std::string_view data,
+                        const bool initPreserveWhiteSpaces = false,
+                        const bool initPreserveComments = false,
+                        const bool initPreserveProcessingInstructions = false,
+                        const std::size_t maxDepth = defaultMaxDepth) noexcept:
+            parser{maxDepth},
+            iterator{data.data()},
+            end{data.data() + data.size()},
+            preserveWhiteSpaces{initPreserveWhiteSpaces},
+            preserveComments{initPreserveComments},
+            preserveProcessingInstructions{initPreserveProcessingInstructions}
+        {
+            if (Parser::hasByteOrderMark(iterator, end))
+                iterator += utf8ByteOrderMark.size();
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        Token next()
+        {
+            parser.attributes.clear();
+
+            if (emptyElement)
+            {
+                emptyElement = false;
+                return token = Token::endElement;
+            }
+
+            for (;;)
+            {
+                if (!preserveWhiteSpaces) Parser::skipWhiteSpaces(iterator, end);
+
+                if (iterator == end)
+                {
+                    if (!open.empty())
+                        throw ParseError{"Unexpected end of data"};
+
+                    if (!rootTagFound)
+                        throw ParseError{"No root tag found"};
+
+                    name = value = std::string_view{};
+                    return token = Token::end;
+                }
+
+                if (*iterator != '<')
+                {
+                    prologAllowed = false;
+                    name = std::string_view{};
+                    value = parser.parseText(iterator, end);
+                    return token = Token::text;
+                }
+
+                if (iterator + 1 != end && *(iterator + 1) == '/')
+                {
+                    if (open.empty())
+                        throw ParseError{"Unexpected end tag"};
+
+                    iterator += 2; // skip the left angle bracket and the slash
+                    Parser::parseEndTag(iterator, end, open.back());
+
+                    name = open.back();
+                    value = std::string_view{};
+                    open.pop_back();
+                    return token = Token::endElement;
+                }
+
+                if (iterator + 1 != end && (*(iterator + 1) == '!' || *(iterator + 1) == '?'))
+                {
+                    Capture capture{*this};
+                    parser.parseElement(iterator, end, capture,
+                                        preserveWhiteSpaces,
+                                        preserveComments,
+                                        preserveProcessingInstructions,
+                                        prologAllowed);
+                    prologAllowed = false;
+
+                    if (capture.captured) return token;
+
+                    continue; // the token was not preserved
                 }
 
-                ++iterator;
+                if (open.empty())
+                {
+                    if (rootTagFound)
+                        throw ParseError{"Multiple root tags found"};
+                    else
+                        rootTagFound = true;
+                }
+
+                ++iterator; // skip the left angle bracket
+                const auto [tagName, empty] = parser.parseStartTag(iterator, end);
+                parser.checkDepth(open.size());
+
+                prologAllowed = false;
+                name = tagName;
+                value = std::string_view{};
+
+                if (empty)
+                    emptyElement = true;
+                else
+                    open.push_back(name);
+
+                return token = Token::startElement;
+            }
+        }
+
+        // Skips the children of the element whose start tag was just read, leaving the reader on its end tag
+        void skipSubtree()
+        {
+            if (token != Token::startElement)
+                throw RangeError{"Not at a start tag"};
+
+            parser.attributes.clear();
+
+            if (emptyElement)
+                emptyElement = false;
+            else
+            {
+                Handler handler;
+                parser.parseContent(iterator, end, handler, open.back(),
+                                    preserveWhiteSpaces,
+                                    preserveComments,
+                                    preserveProcessingInstructions,
+                                    open.size() - 1);
+                open.pop_back();
+            }
+
+            token = Token::endElement;
+        }
+
+        [[nodiscard]] Token getToken() const noexcept { return token; }
+        [[nodiscard]] std::string_view getName() const noexcept { return name; }
+        [[nodiscard]] std::string_view getValue() const noexcept { return value; }
+        [[nodiscard]] const AttributesView& getAttributes() const noexcept { return parser.attributes; }
+        [[nodiscard]] std::size_t getDepth() const noexcept { return open.size(); }
+
+        [[nodiscard]] std::string_view operator[](const std::string_view attribute) const
+        {
+            for (const auto& [key, attributeValue] : parser.attributes)
+                if (key == attribute) return attributeValue;
+
+            throw RangeError{"Invalid attribute"};
+        }
+
+    private:
+        // Records the markup token that the grammar reports
+        struct Capture final: Handler
+        {
+            explicit Capture(Reader& initReader) noexcept: reader{initReader} {}
+
+            void characterData(const std::string_view value) { set(Token::characterData, {}, value); }
+            void comment(const std::string_view value) { set(Token::comment, {}, value); }
+
+            void processingInstruction(const std::string_view name, const std::string_view value)
+            {
+                set(Token::processingInstruction, name, value);
+            }
+
+            void startDocumentTypeDefinition(const std::string_view name, const std::string_view value)
+            {
+                set(Token::documentTypeDefinition, name, value);
+            }
+
+            void set(const Token token, const std::string_view name, const std::string_view value) noexcept
+            {
+                reader.token = token;
+                reader.name = name;
+                reader.value = value;
+                captured = true;
+            }
+
+            Reader& reader;
+            bool captured = false;
+        };
+
+        Parser parser;
+        const char* iterator;
+        const char* end;
+        bool preserveWhiteSpaces;
+        bool preserveComments;
+        bool preserveProcessingInstructions;
+        bool prologAllowed = true;
+        bool rootTagFound = false;
+        bool emptyElement = false; // the end of an empty-element tag is reported by the next call
+        Token token = Token::none;
+        std::string_view name;
+        std::string_view value;
+        std::vector<std::string_view> open; // names of the elements whose end tag has not been read yet
+    };
+
+    // Resumable parser that reports events to handler as chunks of the document arrive;
+    // only the token that is split across chunks is buffered
+    template <class HandlerType>
+    class PushParser final
+    {
+    public:
+        explicit PushParser(HandlerType& initHandler,
+                            const bool initPreserveWhiteSpaces = false,
+                            const bool initPreserveComments = false,
+                            const bool initPreserveProcessingInstructions = false,
+                            const std::size_t maxDepth = defaultMaxDepth) noexcept:
+            handler{initHandler},
+            parser{maxDepth},
+            preserveWhiteSpaces{initPreserveWhiteSpaces},
+            preserveComments{initPreserveComments},
+            preserveProcessingInstructions{initPreserveProcessingInstructions}
+        {
+        }
+
+        PushParser(const PushParser&) = delete;
+        PushParser& operator=(const PushParser&) = delete;
+
+        // A document that fails to parse is discarded, so the next chunk starts a new one
+        void feed(const char* data, const std::size_t size)
+        {
+            try
+            {
+                pending.append(data, size);
+                process(false);
+            }
+            catch (...)
+            {
+                reset();
+                throw;
+            }
+        }
 
-                if (value.empty())
-                    throw ParseError{"Invalid entity"};
+        void feed(const std::string_view data)
+        {
+            feed(data.data(), data.size());
+        }
 
-                if (value[0] == '#') // char reference
-                {
-                    if (value.length() < 2)
-                        throw ParseError{"Invalid entity"};
+        // Parses the rest of the document and checks that it is complete; the parser can be reused afterwards,
+        // even if this throws
+        void finish()
+        {
+            try
+            {
+                process(true);
+            }
+            catch (...)
+            {
+                reset();
+                throw;
+            }
 
-                    char32_t c = 0;
+            const bool complete = open.empty() && rootTagFound;
+            const bool rootFound = rootTagFound;
 
-                    if (value[1] == 'x') // hex value
-                    {
-                        if (value.length() < 3)
-                            throw ParseError{"Invalid entity"};
+            reset();
 
-                        for (std::size_t i = 2; i < value.length(); ++i)
-                        {
-                            std::uint8_t code = 0;
+            if (!complete)
+                throw ParseError{rootFound ? "Unexpected end of data" : "No root tag found"};
+        }
 
-                            if (value[i] >= '0' && value[i] <= '9')
-                                code = static_cast<std::uint8_t>(value[i]) - '0';
-                            else if (value[i] >= 'a' && value[i] <='f')
-                                code = static_cast<std::uint8_t>(value[i]) - 'a' + 10;
-                            else if (value[i] >= 'A' && value[i] <='F')
-                                code = static_cast<std::uint8_t>(value[i]) - 'A' + 10;
-                            else
-                                throw ParseError{"Invalid character code"};
+    private:
+        void reset() noexcept
+        {
+            pending.clear();
+            open.clear();
+            started = false;
+            prologAllowed = true;
+            rootTagFound = false;
+            scan = ScanState{};
+        }
 
-                            c = (c << 4) | code;
-                        }
-                    }
-                    else
-                    {
-                        for (std::size_t i = 1; i < value.length(); ++i)
-                        {
-                            const std::uint8_t code = (value[i] >= '0' && value[i] <= '9') ?
-                                static_cast<std::uint8_t>(value[i]) - '0' :
-                                throw ParseError{"Invalid character code"};
+        void process(const bool final)
+        {
+            const char* iterator = pending.data();
+            const char* end = pending.data() + pending.size();
 
-                            c = c * 10 + code;
-                        }
-                    }
+            if (!started)
+            {
+                // wait until the byte order mark can be told apart from the content
+                if (!final && pending.size() < utf8ByteOrderMark.size() &&
+                    std::equal(iterator, end, utf8ByteOrderMark.begin(),
+                               [](const char c, const std::uint8_t b) noexcept { return static_cast<std::uint8_t>(c) == b; }))
+                    return;
 
-                    result = fromUtf32(c);
-                }
-                else // entity reference
-                {
-                    if (value == "quot")
-                        result = "\"";
-                    else if (value == "amp")
-                        result = "&";
-                    else if (value == "apos")
-                        result = "'";
-                    else if (value == "lt")
-                        result = "<";
-                    else if (value == "gt")
-                        result = ">";
-                    else
-                        throw ParseError{"Invalid entity"};
-                }
+                if (Parser::hasByteOrderMark(iterator, end))
+                    iterator += utf8ByteOrderMark.size();
 
-                return result;
+                started = true;
             }
 
-            [[nodiscard]]
-            static std::string parseString(std::u32string::const_iterator& iterator,
-                                           const std::u32string::const_iterator end)
+            for (;;)
             {
-                std::string result;
-
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+                if (!preserveWhiteSpaces) Parser::skipWhiteSpaces(iterator, end);
 
-                if (*iterator != '"' && *iterator != '\'')
-                    throw ParseError{"Expected quotes"};
+                if (iterator == end) break;
 
-                const auto quotes = *iterator;
+                const auto tokenEnd = findTokenEnd(iterator, end, final);
+                if (tokenEnd == nullptr) break;
 
-                if (++iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+                parseToken(iterator, tokenEnd);
+                scan = ScanState{};
+            }
 
-                while (*iterator != quotes)
-                {
-                    if (*iterator == '&')
-                    {
-                        const auto entity = parseReference(iterator, end);
-                        result += entity;
-                    }
-                    else
-                    {
-                        result += fromUtf32(*iterator);
+            pending.erase(0, static_cast<std::size_t>(iterator - pending.data()));
+        }
 
-                        if (++iterator == end)
-                            throw ParseError{"Unexpected end of data"};
-                    }
-                }
+        // Returns the end of the token at iterator, or nullptr if it continues in the next chunk
+        const char* findTokenEnd(const char* iterator, const char* end, const bool final) noexcept
+        {
+            const auto incomplete = final ? end : nullptr; // the grammar reports truncated tokens
 
-                ++iterator;
+            // the bytes scanned by the previous chunks are not scanned again
+            if (*iterator != '<')
+            {
+                const auto tokenEnd = findAny(iterator + scan.position, end, '<');
+                if (tokenEnd != end || final) return tokenEnd;
 
-                return result;
+                scan.position = static_cast<std::size_t>(end - iterator);
+                return nullptr;
             }
 
-            [[nodiscard]]
-            static Node parseDtdElement(std::u32string::const_iterator& iterator,
-                                        const std::u32string::const_iterator end)
-            {
-                expect(iterator, end, '<');
-                expect(iterator, end, '!');
+            const auto tokenEnd = findMarkupEnd(iterator, end, scan);
+            return tokenEnd != nullptr ? tokenEnd : incomplete;
+        }
 
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+        // Parses the complete token at iterator with the same grammar as Parser::parse
+        void parseToken(const char*& iterator, const char* end)
+        {
+            if (*iterator != '<')
+            {
+                prologAllowed = false;
+                handler.text(parser.parseText(iterator, end));
+            }
+            else if (iterator + 1 != end && *(iterator + 1) == '/')
+            {
+                if (open.empty())
+                    throw ParseError{"Unexpected end tag"};
 
-                Node result;
+                iterator += 2; // skip the left angle bracket and the slash
+                Parser::parseEndTag(iterator, end, open.back());
 
-                if (const auto type = parseName(iterator, end); type == "ELEMENT")
-                {
-                    result = Node::Type::element;
-                }
-                else if (type == "ATTLIST")
-                {
-                    result = Node::Type::attributeList;
-                }
-                else if (type == "ENTITY")
-                {
-                    result = Node::Type::entity;
-                }
-                else if (type == "NOTATION")
+                handler.endElement(open.back());
+                open.pop_back();
+            }
+            else if (iterator + 1 != end && (*(iterator + 1) == '!' || *(iterator + 1) == '?'))
+            {
+                parser.parseElement(iterator, end, handler,
+                                    preserveWhiteSpaces,
+                                    preserveComments,
+                                    preserveProcessingInstructions,
+                                    prologAllowed);
+                prologAllowed = false;
+            }
+            else
+            {
+                if (open.empty())
                 {
-                    result = Node::Type::notation;
+                    if (rootTagFound)
+                        throw ParseError{"Multiple root tags found"};
+                    else
+                        rootTagFound = true;
                 }
 
-                skipWhiteSpaces(iterator, end);
+                ++iterator; // skip the left angle bracket
+                const auto [name, empty] = parser.parseStartTag(iterator, end);
+                parser.checkDepth(open.size());
+                prologAllowed = false;
 
-                result.setName(parseName(iterator, end));
+                handler.startElement(name, std::as_const(parser.attributes));
 
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+                if (empty)
+                    handler.endElement(name);
+                else
+                    open.emplace_back(name);
+            }
 
-                while (*iterator != '>')
-                {
-                    ++iterator;
-                    if (iterator == end)
-                        throw ParseError{"Unexpected end of data"};
-                }
+            if (iterator != end)
+                throw ParseError{"Unexpected data"};
+        }
 
-                ++iterator;
+        HandlerType& handler;
+        Parser parser;
+        bool preserveWhiteSpaces;
+        bool preserveComments;
+        bool preserveProcessingInstructions;
+        bool started = false;
+        bool prologAllowed = true;
+        bool rootTagFound = false;
+        ScanState scan; // how far the pending token has been scanned for its end
+        std::string pending; // the unparsed rest of the received chunks
+        std::vector<std::string> open; // names of the elements whose end tag has not been reached yet
+    };
 
-                return result;
-            }
+    inline namespace detail
+    {
+        // Parses the chunks returned by read until it returns zero, without keeping the whole input in memory
+        template <class Document, class Read>
+        void parseChunks(const Read& read,
+                         Document& result,
+                         const bool preserveWhiteSpaces,
+                         const bool preserveComments,
+                         const bool preserveProcessingInstructions,
+                         const std::size_t maxDepth)
+        {
+            Builder<Document> builder{result, nullptr, nullptr};
+            PushParser<Builder<Document>> parser{builder,
+                                                 preserveWhiteSpaces,
+                                                 preserveComments,
+                                                 preserveProcessingInstructions,
+                                                 maxDepth};
+
+            std::vector<char> chunk(65536);
+            while (const auto size = read(chunk.data(), chunk.size()))
+                parser.feed(chunk.data(), size);
+
+            parser.finish();
+        }
 
-            [[nodiscard]]
-            static Node parseElement(std::u32string::const_iterator& iterator,
-                                     const std::u32string::const_iterator end,
-                                     const bool preserveWhiteSpaces,
-                                     const bool preserveComments,
-                                     const bool preserveProcessingInstructions,
-                                     const bool prologAllowed)
+#if defined(XML_MMAP)
+        // Owns a file descriptor
+        class File final
+        {
+        public:
+            explicit File(const std::string& path):
+                descriptor{::open(path.c_str(), O_RDONLY | O_CLOEXEC)}
             {
-                expect(iterator, end, '<');
+                if (descriptor == -1)
+                    throw std::system_error{errno, std::system_category(), "Failed to open " + path};
+            }
 
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
+            ~File() { ::close(descriptor); }
 
-                Node result;
+            File(const File&) = delete;
+            File& operator=(const File&) = delete;
 
-                if (*iterator == '!') // <!
-                {
-                    if (++iterator == end)
-                        throw ParseError{"Unexpected end of data"};
+            [[nodiscard]] int get() const noexcept { return descriptor; }
 
-                    if (*iterator == '-') // <!-
-                    {
-                        ++iterator;
+        private:
+            int descriptor;
+        };
 
-                        expect(iterator, end, '-'); // <!--
+        // Owns a memory mapping
+        class Mapping final
+        {
+        public:
+            Mapping(void* initData, const std::size_t initSize) noexcept:
+                data{initData}, size{initSize}
+            {
+            }
 
-                        result = Node::Type::comment;
+            ~Mapping() { ::munmap(data, size); }
 
-                        std::string value;
-                        for (;;)
-                        {
-                            if (std::distance(iterator, end) < 3)
-                                throw ParseError{"Unexpected end of data"};
+            Mapping(const Mapping&) = delete;
+            Mapping& operator=(const Mapping&) = delete;
 
-                            if (*iterator == '-')
-                            {
-                                if (*(iterator + 1) == '-') // --
-                                {
-                                    iterator += 2;
-
-                                    if (*iterator == '>') // -->
-                                    {
-                                        ++iterator;
-                                        break;
-                                    }
-                                    else
-                                        throw ParseError{"Unexpected double-hyphen inside comment"};
-                                }
-                            }
+        private:
+            void* data;
+            std::size_t size;
+        };
+#endif
+    }
 
-                            value += fromUtf32(*iterator);
-                            ++iterator;
-                        }
+    // Parses the file at path in place from a memory mapping when possible,
+    // otherwise reads it in chunks so that pipes and devices work too
+    [[nodiscard]]
+    inline Data parseFile(const std::string& path,
+                          const bool preserveWhiteSpaces = false,
+                          const bool preserveComments = false,
+                          const bool preserveProcessingInstructions = false,
+                          const std::size_t maxDepth = defaultMaxDepth)
+    {
+        Data result;
 
-                        result.setValue(value);
-                    }
-                    else if (*iterator == '[') // <![
-                    {
-                        ++iterator;
-                        std::string name;
-                        name = parseName(iterator, end);
+#if defined(XML_MMAP)
+        const File file{path};
 
-                        if (name != "CDATA")
-                            throw ParseError{"Expected CDATA"};
+        struct stat status;
+        if (::fstat(file.get(), &status) == -1)
+            throw std::system_error{errno, std::system_category(), "Failed to stat " + path};
 
-                        if (iterator == end)
-                            throw ParseError{"Unexpected end of data"};
+        if (S_ISREG(status.st_mode) && status.st_size > 0)
+        {
+            const auto size = static_cast<std::size_t>(status.st_size);
 
-                        expect(iterator, end, '[');
+            if (const auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.get(), 0); data != MAP_FAILED)
+            {
+                const Mapping mapping{data, size};
+                ::madvise(data, size, MADV_SEQUENTIAL);
+
+                const auto begin = static_cast<const char*>(data);
+                parseDocument(begin, begin + size, result,
+                              preserveWhiteSpaces,
+                              preserveComments,
+                              preserveProcessingInstructions,
+                              maxDepth);
+                return result;
+            }
+        }
 
-                        result = Node::Type::characterData;
+        parseChunks([&file, &path](char* buffer, const std::size_t size) {
+            for (;;)
+            {
+                if (const auto count = ::read(file.get(), buffer, size); count != -1)
+                    return static_cast<std::size_t>(count);
+                else if (errno != EINTR)
+                    throw std::system_error{errno, std::system_category(), "Failed to read " + path};
+            }
+        }, result, preserveWhiteSpaces, preserveComments, preserveProcessingInstructions, maxDepth);
+#else
+        const std::unique_ptr<std::FILE, int(*)(std::FILE*)> file{std::fopen(path.c_str(), "rb"), &std::fclose};
+        if (!file)
+            throw std::system_error{errno, std::generic_category(), "Failed to open " + path};
+
+        parseChunks([&file, &path](char* buffer, const std::size_t size) {
+            const auto count = std::fread(buffer, 1, size, file.get());
+            if (count == 0 && std::ferror(file.get()))
+                throw std::system_error{errno, std::generic_category(), "Failed to read " + path};
+            return count;
+        }, result, preserveWhiteSpaces, preserveComments, preserveProcessingInstructions, maxDepth);
+#endif
+
+        return result;
+    }
 
-                        std::string value;
-                        for (;;)
-                        {
-                            if (std::distance(iterator, end) < 3)
-                                throw ParseError{"Unexpected end of data"};
+    inline namespace detail
+    {
+        // Collects the output in a fixed-size buffer and passes it to write whenever it fills up
+        template <class Write>
+        class BufferedOutput final
+        {
+        public:
+            explicit BufferedOutput(Write& initWrite) noexcept: write{initWrite} {}
 
-                            if (*iterator == ']' &&
-                                *(iterator + 1) == ']' &&
-                                *(iterator + 2) == '>')
-                            {
-                                iterator += 3;
-                                break;
-                            }
+            BufferedOutput(const BufferedOutput&) = delete;
+            BufferedOutput& operator=(const BufferedOutput&) = delete;
 
-                            value += fromUtf32(*iterator);
-                            ++iterator;
-                        }
-                        result.setValue(value);
-                    }
-                    else // <!
+            void push_back(const char c)
+            {
+                if (size == buffer.size()) flush();
+                buffer[size++] = c;
+            }
+
+            void append(const std::string_view str)
+            {
+                if (str.size() > buffer.size() - size)
+                {
+                    flush();
+
+                    // strings that do not fit into the buffer are written directly
+                    if (str.size() >= buffer.size())
                     {
-                        std::string type;
-                        type = parseName(iterator, end);
+                        write(str.data(), str.size());
+                        return;
+                    }
+                }
 
-                        if (type != "DOCTYPE")
-                            throw ParseError{"Invalid document type declaration"};
+                std::memcpy(buffer.data() + size, str.data(), str.size());
+                size += str.size();
+            }
 
-                        result = Node::Type::documentTypeDefinition;
+            void append(std::size_t count, const char c)
+            {
+                while (count--) push_back(c);
+            }
 
-                        skipWhiteSpaces(iterator, end);
+            void flush()
+            {
+                if (size == 0) return;
 
-                        const auto name = parseName(iterator, end);
-                        result.setName(name);
+                write(buffer.data(), size);
+                size = 0;
+            }
 
-                        skipWhiteSpaces(iterator, end);
-                        
-                        if (iterator == end)
-                            throw ParseError{"Unexpected end of data"};
+        private:
+            Write& write;
+            std::array<char, 4096> buffer;
+            std::size_t size = 0;
+        };
 
-                        if (*iterator == '[')
-                        {
-                            if (++iterator == end)
-                                throw ParseError{"Unexpected end of data"};
+        // Only counts the bytes, used to compute the exact size of the output
+        class CountingOutput final
+        {
+        public:
+            void push_back(char) noexcept { ++size; }
+            void append(const std::string_view str) noexcept { size += str.size(); }
+            void append(const std::size_t count, char) noexcept { size += count; }
 
-                            skipWhiteSpaces(iterator, end);
+            [[nodiscard]] std::size_t getSize() const noexcept { return size; }
 
-                            if (iterator == end)
-                                throw ParseError{"Unexpected end of data"};
+        private:
+            std::size_t size = 0;
+        };
 
-                            while (*iterator != ']')
-                            {
-                                result.pushBack(parseDtdElement(iterator, end));
+        // Writes to a buffer that is known to be large enough
+        class PointerOutput final
+        {
+        public:
+            explicit PointerOutput(char* initIterator) noexcept: iterator{initIterator} {}
 
-                                skipWhiteSpaces(iterator, end);
+            void push_back(const char c) noexcept { *iterator++ = c; }
 
-                                if (iterator == end)
-                                    throw ParseError{"Unexpected end of data"};
-                            }
+            void append(const std::string_view str) noexcept
+            {
+                std::memcpy(iterator, str.data(), str.size());
+                iterator += str.size();
+            }
 
-                            ++iterator;
-                        }
-                        else
-                        {
-                            std::string value;
-                            while (*iterator != '>')
-                            {
-                                value += fromUtf32(*iterator);
+            void append(const std::size_t count, const char c) noexcept
+            {
+                std::memset(iterator, c, count);
+                iterator += count;
+            }
 
-                                if (++iterator == end)
-                                    throw ParseError{"Unexpected end of data"};
-                            }
-                            result.setValue(value);
-                        }
+        private:
+            char* iterator;
+        };
 
-                        skipWhiteSpaces(iterator, end);
+        // Calls first(i) for every i in [0, count) on up to threads threads, including the calling one, then
+        // between() on the calling thread once all of them have returned, then second(i) for every i on the same
+        // threads; rethrows the first exception, after which the remaining calls are skipped
+        template <class First, class Between, class Second>
+        void forEachParallel(const std::size_t count, const std::size_t threads,
+                             const First& first, const Between& between, const Second& second)
+        {
+            std::atomic<std::size_t> nextFirst{0};
+            std::atomic<std::size_t> nextSecond{0};
+            std::exception_ptr error;
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::size_t arrived = 0; // workers that are done with first
+            bool secondStarted = false;
+
+            const auto run = [&](std::atomic<std::size_t>& next, const auto& function) noexcept {
+                for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+                {
+                    try
+                    {
+                        function(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard lock{mutex};
+                        if (!error) error = std::current_exception();
+                    }
+                }
+            };
 
-                        if (iterator == end)
-                            throw ParseError{"Unexpected end of data"};
+            const auto work = [&]() noexcept {
+                run(nextFirst, first);
+                {
+                    std::unique_lock lock{mutex};
+                    ++arrived;
+                    condition.notify_all();
+                    condition.wait(lock, [&secondStarted]() noexcept { return secondStarted; });
+                    if (error) return;
+                }
+                run(nextSecond, second);
+            };
+
+            // reserved before any thread is started, so that only starting a thread can fail below
+            const auto workerCount = std::max(std::size_t{1}, std::min(threads, count));
+            std::vector<std::thread> workers;
+            workers.reserve(workerCount - 1);
+            try
+            {
+                for (std::size_t i = 1; i < workerCount; ++i)
+                    workers.emplace_back(work);
+            }
+            catch (...)
+            {
+                // the remaining indices are taken by the threads that were started
+            }
 
-                        if (*iterator != '>')
-                            throw ParseError{"Expected a right angle bracket"};
+            run(nextFirst, first);
+            {
+                std::unique_lock lock{mutex};
+                condition.wait(lock, [&arrived, &workers]() noexcept { return arrived == workers.size(); });
+            }
 
-                        ++iterator;
-                    }
+            bool failed;
+            {
+                std::lock_guard lock{mutex};
+                failed = static_cast<bool>(error);
+            }
 
+            if (!failed)
+            {
+                try
+                {
+                    between();
                 }
-                else if (*iterator == '?') // <?
+                catch (...)
                 {
-                    ++iterator;
-                    result = Node::Type::processingInstruction;
+                    std::lock_guard lock{mutex};
+                    error = std::current_exception();
+                    failed = true;
+                }
+            }
 
-                    const auto name = parseName(iterator, end);
-                    if (!prologAllowed && name.length() == 3 &&
-                        std::tolower(name[0]) == 'x' &&
-                        std::tolower(name[1]) == 'm' &&
-                        std::tolower(name[2]) == 'l')
-                    {
-                        throw ParseError{"Invalid processing instruction"};
-                    }
+            {
+                std::lock_guard lock{mutex};
+                secondStarted = true;
+            }
+            condition.notify_all();
 
-                    result.setName(name);
+            if (!failed) run(nextSecond, second);
+            for (auto& worker : workers) worker.join();
 
-                    skipWhiteSpaces(iterator, end);
+            if (error) std::rethrow_exception(error);
+        }
 
-                    if (iterator == end)
-                        throw ParseError{"Unexpected end of data"};
+        // Serializes nodes to Output, which is std::string, BufferedOutput, CountingOutput or PointerOutput
+        template <class Allocator>
+        class Encoder final
+        {
+        public:
+            using NodeType = BasicNode<Allocator>;
 
-                    std::string value;
+            template <class Output>
+            static void encode(const BasicData<Allocator>& data, Output& result,
+                               const bool whitespaces, const bool byteOrderMark)
+            {
+                if (byteOrderMark)
+                    result.append(std::string_view{reinterpret_cast<const char*>(utf8ByteOrderMark.data()),
+                                                   utf8ByteOrderMark.size()});
 
-                    while (*iterator != '?')
-                    {
-                        value += fromUtf32(*iterator);
+                for (const NodeType& node : data)
+                {
+                    encode(node, result, whitespaces);
+                    if (whitespaces) result.push_back('\n');
+                }
+            }
 
-                        if (++iterator == end)
-                            throw ParseError{"Unexpected end of data"};
-                    }
+            // Cuts the document into the tags of the elements near the root, which are encoded up front,
+            // and the subtrees between them, which are sized and then written to their offsets on up to threads threads;
+            // a document with fewer than minimumParallelNodes nodes is encoded sequentially
+            static std::string encodeParallel(const BasicData<Allocator>& data, const std::size_t threads,
+                                              const bool whitespaces, const bool byteOrderMark)
+            {
+                if (threads <= 1 || !hasNodes(data, minimumParallelNodes))
+                {
+                    CountingOutput counter;
+                    encode(data, counter, whitespaces, byteOrderMark);
 
-                    if (++iterator == end)
-                        throw ParseError{"Unexpected end of data"};
+                    std::string result;
+                    result.reserve(counter.getSize());
+                    encode(data, result, whitespaces, byteOrderMark);
+                    return result;
+                }
 
-                    expect(iterator, end, '>');
+                Segments segments;
+                if (byteOrderMark)
+                    segments.literals.append(reinterpret_cast<const char*>(utf8ByteOrderMark.data()),
+                                             utf8ByteOrderMark.size());
 
-                    result.setValue(value);
-                }
-                else // <
+                for (const NodeType& node : data)
                 {
-                    result = Node::Type::tag;
-                    result.setName(parseName(iterator, end));
+                    split(node, 0, data.getChildren().size(), threads, whitespaces, segments);
+                    if (whitespaces) segments.literals.push_back('\n');
+                }
+                segments.closeLiteral();
 
-                    bool tagClosed = false;
+                auto& parts = segments.parts;
+                std::string result;
 
-                    for (;;)
+                forEachParallel(parts.size(), threads, [&parts, whitespaces](const std::size_t i) {
+                    if (auto& part = parts[i]; part.node)
                     {
-                        skipWhiteSpaces(iterator, end);
-
-                        if (iterator == end)
-                            throw ParseError{"Unexpected end of data"};
-
-                        if (*iterator == '>')
-                        {
-                            ++iterator;
-                            break;
-                        }
-                        else if (*iterator == '/')
-                        {
-                            ++iterator;
+                        CountingOutput output;
+                        encode(*part.node, output, whitespaces, part.level);
+                        part.size = output.getSize();
+                    }
+                }, [&parts, &result]() {
+                    std::size_t size = 0;
+                    for (auto& part : parts)
+                    {
+                        part.offset = size;
+                        size += part.size;
+                    }
 
-                            expect(iterator, end, '>');
+                    result.resize(size);
+                }, [&](const std::size_t i) {
+                    const auto& part = parts[i];
+                    if (part.node)
+                    {
+                        PointerOutput output{result.data() + part.offset};
+                        encode(*part.node, output, whitespaces, part.level);
+                    }
+                    else
+                        std::memcpy(result.data() + part.offset, segments.literals.data() + part.source, part.size);
+                });
 
-                            tagClosed = true;
-                            break;
-                        }
+                return result;
+            }
 
-                        const auto attribute = parseName(iterator, end);
+        private:
+            // Piece of the output of encodeParallel: either a subtree or a range of literals
+            struct Part final
+            {
+                const NodeType* node; // nullptr for literals
+                std::size_t level;
+                std::size_t source; // offset in literals
+                std::size_t size;
+                std::size_t offset; // offset in the output
+            };
+
+            struct Segments final
+            {
+                void addNode(const NodeType& node, const std::size_t level)
+                {
+                    closeLiteral();
+                    parts.push_back(Part{&node, level, 0, 0, 0});
+                }
 
-                        skipWhiteSpaces(iterator, end);
+                void closeLiteral()
+                {
+                    if (literals.size() == pending) return;
 
-                        expect(iterator, end, '=');
+                    parts.push_back(Part{nullptr, 0, pending, literals.size() - pending, 0});
+                    pending = literals.size();
+                }
 
-                        skipWhiteSpaces(iterator, end);
+                std::string literals;
+                std::size_t pending = 0; // start of the literals not in parts yet
+                std::vector<Part> parts;
+            };
 
-                        result[attribute] = parseString(iterator, end);
-                    }
+            // Elements deeper than this are never cut into tags and children
+            static constexpr std::size_t maxSplitLevel = 8;
 
-                    if (!tagClosed)
-                    {
-                        for (;;)
-                        {
-                            if (!preserveWhiteSpaces) skipWhiteSpaces(iterator, end);
+            // Smaller documents take longer to hand to threads than to encode
+            static constexpr std::size_t minimumParallelNodes = 4096;
 
-                            if (iterator == end)
-                                throw ParseError{"Unexpected end of data"};
+            // Counts the nodes down from count and stops as soon as there are at least count of them
+            static bool hasNodes(const BasicData<Allocator>& data, std::size_t count) noexcept
+            {
+                for (const NodeType& node : data)
+                    if (hasNodes(node, count)) return true;
 
-                            if (*iterator == '<' &&
-                                iterator + 1 != end &&
-                                *(iterator + 1) == '/')
-                            {
-                                ++iterator; // skip the left angle bracket
-                                ++iterator; // skip the slash
+                return false;
+            }
 
-                                if (const auto tag = parseName(iterator, end); tag != result.getName())
-                                    throw ParseError{"Tag not closed properly"};
+            static bool hasNodes(const NodeType& node, std::size_t& count) noexcept
+            {
+                if (--count == 0) return true;
 
-                                expect(iterator, end, '>');
-                                break;
-                            }
-                            else
-                            {
-                                const auto node = parse(iterator, end,
-                                                        preserveWhiteSpaces,
-                                                        preserveComments,
-                                                        preserveProcessingInstructions,
-                                                        false);
-
-                                if ((preserveComments || node.getType() != Node::Type::comment) &&
-                                    (preserveProcessingInstructions || node.getType() != Node::Type::processingInstruction))
-                                    result.pushBack(node);
-                            }
-                        }
-                    }
-                }
+                for (const NodeType& child : node.getChildren())
+                    if (hasNodes(child, count)) return true;
 
-                return result;
+                return false;
             }
 
-            [[nodiscard]]
-            static Node parseText(std::u32string::const_iterator& iterator,
-                                  const std::u32string::const_iterator end)
+            // Keeps cutting elements into tags and children while there are fewer siblings than threads
+            static void split(const NodeType& node, const std::size_t level, const std::size_t siblings,
+                              const std::size_t threads, const bool whitespaces, Segments& segments)
             {
-                Node result;
-                result = Node::Type::text;
+                const auto& children = node.getChildren();
+                if (node.getType() != NodeType::Type::tag || children.empty() ||
+                    (level != 0 && (siblings >= threads || level >= maxSplitLevel)))
+                {
+                    segments.addNode(node, level);
+                    return;
+                }
 
-                std::string value;
-                for (;;)
+                auto& literals = segments.literals;
+                encodeStartTag(node, literals);
+                literals.push_back('>');
+                if (whitespaces) literals.push_back('\n');
+
+                for (const NodeType& child : children)
                 {
-                    if (iterator == end || // end of a file
-                        *iterator == '<') // start of a tag
-                        break;
-                    else if (*iterator == '&')
-                    {
-                        const auto entity = parseReference(iterator, end);
-                        value += entity;
-                    }
-                    else
-                    {
-                        value += fromUtf32(*iterator);
-                        ++iterator;
-                    }
+                    if (whitespaces) literals.append(level + 1, '\t');
+                    split(child, level + 1, children.size(), threads, whitespaces, segments);
+                    if (whitespaces) literals.push_back('\n');
                 }
-                result.setValue(value);
-                return result;
+
+                if (whitespaces) literals.append(level, '\t');
+                literals.append("</");
+                literals.append(std::string_view{node.getName()});
+                literals.push_back('>');
             }
 
-            [[nodiscard]]
-            static Node parse(std::u32string::const_iterator& iterator,
-                              const std::u32string::const_iterator end,
-                              const bool preserveWhiteSpaces,
-                              const bool preserveComments,
-                              const bool preserveProcessingInstructions,
-                              const bool prologAllowed)
+            // Copies the runs that need no escaping in bulk
+            template <class Output>
+            static void escape(const std::string_view str, Output& result)
             {
+                auto iterator = str.data();
+                const auto end = str.data() + str.size();
 
-                if (iterator == end)
-                    throw ParseError{"Unexpected end of data"};
-
-                if (*iterator == '<')
-                    return parseElement(iterator, end,
-                                        preserveWhiteSpaces,
-                                        preserveComments,
-                                        preserveProcessingInstructions,
-                                        prologAllowed);
-                else
-                    return parseText(iterator, end);
-            }
-        };
+                for (;;)
+                {
+                    const auto next = findEscaped(iterator, end);
+                    result.append(std::string_view(iterator, static_cast<std::size_t>(next - iterator)));
 
-        return Parser::parse(begin, end,
-                             preserveWhiteSpaces,
-                             preserveComments,
-                             preserveProcessingInstructions);
-    }
+                    if (next == end) break;
 
-    [[nodiscard]]
-    inline Data parse(const char* data,
-                      const bool preserveWhiteSpaces = false,
-                      const bool preserveComments = false,
-                      const bool preserveProcessingInstructions = false)
-    {
-        return parse(data, data + std::strlen(data),
-                     preserveWhiteSpaces,
-                     preserveComments,
-                     preserveProcessingInstructions);
-    }
+                    switch (*next)
+                    {
+                        case '"': result.append("&quot;"); break;
+                        case '&': result.append("&amp;"); break;
+                        case '\'': result.append("&apos;"); break;
+                        case '<': result.append("&lt;"); break;
+                        case '>': result.append("&gt;"); break;
+                    }
 
-    template <class T>
-    [[nodiscard]]
-    Data parse(const T& data,
-               const bool preserveWhiteSpaces = false,
-               const bool preserveComments = false,
-               const bool preserveProcessingInstructions = false)
-    {
-        using std::begin, std::end; // add std::begin and std::end to lookup
-        return parse(begin(data), end(data),
-                     preserveWhiteSpaces,
-                     preserveComments,
-                     preserveProcessingInstructions);
-    }
+                    iterator = next + 1;
+                }
+            }
 
-    [[nodiscard]]
-    inline std::string encode(const Data& data,
-                              const bool whitespaces = false,
-                              const bool byteOrderMark = false)
-    {
-        class Encoder final
-        {
-        public:
-            [[nodiscard]] 
-            static std::string encode(const Data& data, bool whitespaces, bool byteOrderMark)
+            // Appends the start tag without the closing angle bracket
+            template <class Output>
+            static void encodeStartTag(const NodeType& node, Output& result)
             {
-                std::string result;
-                if (byteOrderMark) result.assign(utf8ByteOrderMark.begin(),
-                                                 utf8ByteOrderMark.end());
+                result.push_back('<');
+                result.append(std::string_view{node.getName()});
 
-                for (const Node& node : data)
+                for (const auto& [key, attributeValue] : node.getAttributes())
                 {
-                    encode(node, result, whitespaces);
-                    if (whitespaces) result.push_back('\n');
+                    result.push_back(' ');
+                    result.append(std::string_view{key});
+                    result.append("=\"");
+                    escape(attributeValue, result);
+                    result.push_back('"');
                 }
-
-                return result;
             }
 
-        private:
-            static void encode(const std::string& str,
-                               std::string& result)
+            // Appends a space and the value unless it is empty
+            template <class Output>
+            static void encodeValue(const NodeType& node, Output& result)
             {
-                for (const char c : str)
+                if (const auto& value = node.getValue(); !value.empty())
                 {
-                    switch (c)
-                    {
-                        case '"':
-                            result.insert(result.end(), {'&', 'q', 'u', 'o', 't', ';'});
-                            break;
-                        case '&':
-                            result.insert(result.end(), {'&', 'a', 'm', 'p', ';'});
-                            break;
-                        case '\'':
-                            result.insert(result.end(), {'&', 'a', 'p', 'o', 's', ';'});
-                            break;
-                        case '<':
-                            result.insert(result.end(), {'&', 'l', 't', ';'});
-                            break;
-                        case '>':
-                            result.insert(result.end(), {'&', 'g', 't', ';'});
-                            break;
-                        default:
-                            result.insert(result.end(), c);
-                            break;
-                    }
+                    result.push_back(' ');
+                    result.append(std::string_view{value});
                 }
             }
 
-            static void encode(const Node& node, std::string& result,
+            template <class Output>
+            static void encode(const NodeType& node, Output& result,
                                const bool whitespaces,
                                const std::size_t level = 0)
             {
                 switch (node.getType())
                 {
-                    case Node::Type::comment:
-                    {
-                        const auto& value = node.getValue();
-                        result.insert(result.end(), {'<', '!', '-', '-'});
-                        result.insert(result.end(), value.begin(), value.end());
-                        result.insert(result.end(), {'-', '-', '>'});
+                    case NodeType::Type::comment:
+                        result.append("<!--");
+                        result.append(std::string_view{node.getValue()});
+                        result.append("-->");
                         break;
-                    }
-                    case Node::Type::characterData:
-                    {
-                        const auto& value = node.getValue();
-                        result.insert(result.end(), {'<', '!', '[', 'C', 'D', 'A', 'T', 'A', '['});
-                        result.insert(result.end(), value.begin(), value.end());
-                        result.insert(result.end(), {']', ']', '>'});
+                    case NodeType::Type::characterData:
+                        result.append("<![CDATA[");
+                        result.append(std::string_view{node.getValue()});
+                        result.append("]]>");
                         break;
-                    }
-                    case Node::Type::processingInstruction:
-                    {
-                        const auto& name = node.getName();
-                        result.insert(result.end(), {'<', '?'});
-                        result.insert(result.end(), name.begin(), name.end());
-
-                        const auto& value = node.getValue();
-                        result.insert(result.end(), ' ');
-                        result.insert(result.end(), value.begin(), value.end());
-                        result.insert(result.end(), {'?', '>'});
+                    case NodeType::Type::processingInstruction:
+                        result.append("<?");
+                        result.append(std::string_view{node.getName()});
+                        result.push_back(' ');
+                        result.append(std::string_view{node.getValue()});
+                        result.append("?>");
                         break;
-                    }
-                    case Node::Type::documentTypeDefinition:
+                    case NodeType::Type::documentTypeDefinition:
                     {
-                        const auto& name = node.getName();
-                        result.insert(result.end(), {'<', '!', 'D', 'O', 'C', 'T', 'Y', 'P', 'E', ' '});
-                        result.insert(result.end(), name.begin(), name.end());
+                        result.append("<!DOCTYPE ");
+                        result.append(std::string_view{node.getName()});
 
                         switch (node.getExternalIdType())
                         {
-                            case Node::ExternalIdType::none: break;
-                            case Node::ExternalIdType::system:
-                                result.insert(result.end(), {' ', 'S', 'Y', 'S', 'T', 'E', 'M'});
-                                break;
-                            case Node::ExternalIdType::pub:
-                                result.insert(result.end(), {' ', 'P', 'U', 'B', 'L', 'I', 'C'});
-                                break;
+                            case NodeType::ExternalIdType::none: break;
+                            case NodeType::ExternalIdType::system: result.append(" SYSTEM"); break;
+                            case NodeType::ExternalIdType::pub: result.append(" PUBLIC"); break;
                         }
 
-                        const auto& value = node.getValue();
-                        if (!value.empty())
-                        {
-                            result.insert(result.end(), ' ');
-                            result.insert(result.end(), value.begin(), value.end());
-                        }
+                        encodeValue(node, result);
 
                         if (const auto& children = node.getChildren(); !children.empty())
                         {
-                            result.insert(result.end(), {' ', '['});
+                            result.append(" [");
                             if (whitespaces) result.push_back('\n');
 
-                            for (const Node& child : children)
+                            for (const NodeType& child : children)
                             {
-                                if (whitespaces) result.insert(result.end(), level + 1, '\t');
+                                if (whitespaces) result.append(level + 1, '\t');
                                 encode(child, result, whitespaces, level + 1);
                                 if (whitespaces) result.push_back('\n');
                             }
 
-                            if (whitespaces) result.insert(result.end(), level, '\t');
-                            result.insert(result.end(), ']');
+                            if (whitespaces) result.append(level, '\t');
+                            result.push_back(']');
                         }
 
-                        result.insert(result.end(), '>');
-
+                        result.push_back('>');
                         break;
                     }
-                    case Node::Type::element:
-                    {
-                        const auto& name = node.getName();
-                        result.insert(result.end(), {'<', '!', 'E', 'L', 'E', 'M', 'E', 'N', 'T', ' '});
-                        result.insert(result.end(), name.begin(), name.end());
-
-                        const auto& value = node.getValue();
-                        if (!value.empty())
-                        {
-                            result.insert(result.end(), ' ');
-                            result.insert(result.end(), value.begin(), value.end());
-                        }
-                        result.insert(result.end(), '>');
+                    case NodeType::Type::element:
+                        result.append("<!ELEMENT ");
+                        result.append(std::string_view{node.getName()});
+                        encodeValue(node, result);
+                        result.push_back('>');
                         break;
-                    }
-                    case Node::Type::attributeList:
-                    {
-                        const auto& name = node.getName();
-                        result.insert(result.end(), {'<', '!', 'A', 'T', 'T', 'L', 'I', 'S', 'T', ' '});
-                        result.insert(result.end(), name.begin(), name.end());
-
-                        const auto& value = node.getValue();
-                        if (!value.empty())
-                        {
-                            result.insert(result.end(), ' ');
-                            result.insert(result.end(), value.begin(), value.end());
-                        }
-                        result.insert(result.end(), '>');
+                    case NodeType::Type::attributeList:
+                        result.append("<!ATTLIST ");
+                        result.append(std::string_view{node.getName()});
+                        encodeValue(node, result);
+                        result.push_back('>');
                         break;
-                    }
-                    case Node::Type::entity:
-                    {
-                        const auto& name = node.getName();
-                        result.insert(result.end(), {'<', '!', 'E', 'N', 'T', 'I', 'T', 'Y', ' '});
-                        result.insert(result.end(), name.begin(), name.end());
-
-                        const auto& value = node.getValue();
-                        if (!value.empty())
-                        {
-                            result.insert(result.end(), ' ');
-                            result.insert(result.end(), value.begin(), value.end());
-                        }
-                        result.insert(result.end(), '>');
+                    case NodeType::Type::entity:
+                        result.append("<!ENTITY ");
+                        result.append(std::string_view{node.getName()});
+                        encodeValue(node, result);
+                        result.push_back('>');
                         break;
-                    }
-                    case Node::Type::notation:
-                    {
-                        const auto& name = node.getName();
-                        result.insert(result.end(), {'<', '!', 'N', 'O', 'T', 'A', 'T', 'I', 'O', 'N', ' '});
-                        result.insert(result.end(), name.begin(), name.end());
-
-                        const auto& value = node.getValue();
-                        if (!value.empty())
-                        {
-                            result.insert(result.end(), ' ');
-                            result.insert(result.end(), value.begin(), value.end());
-                        }
-                        result.insert(result.end(), '>');
+                    case NodeType::Type::notation:
+                        result.append("<!NOTATION ");
+                        result.append(std::string_view{node.getName()});
+                        encodeValue(node, result);
+                        result.push_back('>');
                         break;
-                    }
-                    case Node::Type::tag:
+                    case NodeType::Type::tag:
                     {
-                        const auto& name = node.getName();
-                        result.insert(result.end(), '<');
-                        result.insert(result.end(), name.begin(), name.end());
-
-                        const auto& attributes = node.getAttributes();
-                        for (const auto& [key, attributeValue] : attributes)
-                        {
-                            result.insert(result.end(), ' ');
-                            result.insert(result.end(), key.begin(), key.end());
-                            result.insert(result.end(), {'=', '"'});
-                            result.insert(result.end(), attributeValue.begin(), attributeValue.end());
-                            result.insert(result.end(), '"');
-                        }
+                        const std::string_view name = node.getName();
+                        encodeStartTag(node, result);
 
                         if (const auto& children = node.getChildren(); !children.empty())
                         {
-                            result.insert(result.end(), '>');
+                            result.push_back('>');
                             if (whitespaces) result.push_back('\n');
 
-                            for (const Node& child : children)
+                            for (const NodeType& child : children)
                             {
-                                if (whitespaces) result.insert(result.end(), level + 1, '\t');
+                                if (whitespaces) result.append(level + 1, '\t');
                                 encode(child, result, whitespaces, level + 1);
                                 if (whitespaces) result.push_back('\n');
                             }
 
-                            if (whitespaces) result.insert(result.end(), level, '\t');
-                            result.insert(result.end(), {'<', '/'});
-                            result.insert(result.end(), name.begin(), name.end());
-                            result.insert(result.end(), '>');
+                            if (whitespaces) result.append(level, '\t');
+                            result.append("</");
+                            result.append(name);
+                            result.push_back('>');
                         }
                         else
-                            result.insert(result.end(), {'/', '>'});
+                            result.append("/>");
                         break;
                     }
-                    case Node::Type::text:
-                    {
-                        const auto& value = node.getValue();
-                        encode(value, result);
+                    case NodeType::Type::text:
+                        escape(node.getValue(), result);
                         break;
-                    }
                     default:
                         throw ParseError{"Unknown node type"};
                 }
             }
         };
+    }
+
+    // Returns the exact number of bytes encode produces for data, including escapes and indentation
+    template <class Allocator>
+    [[nodiscard]]
+    std::size_t encodedSize(const BasicData<Allocator>& data,
+                            const bool whitespaces = false,
+                            const bool byteOrderMark = false)
+    {
+        CountingOutput output;
+        Encoder<Allocator>::encode(data, output, whitespaces, byteOrderMark);
+        return output.getSize();
+    }
 
-        return Encoder::encode(data, whitespaces, byteOrderMark);
+    template <class Allocator>
+    [[nodiscard]]
+    std::string encode(const BasicData<Allocator>& data,
+                       const bool whitespaces = false,
+                       const bool byteOrderMark = false)
+    {
+        std::string result;
+        result.reserve(encodedSize(data, whitespaces, byteOrderMark));
+        Encoder<Allocator>::encode(data, result, whitespaces, byteOrderMark);
+        return result;
+    }
+
+    // Encodes the subtrees near the root of data on up to threads threads, with the same output as encode
+    template <class Allocator>
+    [[nodiscard]]
+    std::string encodeParallel(const BasicData<Allocator>& data,
+                               const std::size_t threads = std::thread::hardware_concurrency(),
+                               const bool whitespaces = false,
+                               const bool byteOrderMark = false)
+    {
+        return Encoder<Allocator>::encodeParallel(data, threads, whitespaces, byteOrderMark);
+    }
+
+    // Encodes data into buffer without allocating and returns the encoded size;
+    // if it is larger than capacity, nothing is written
+    template <class Allocator>
+    std::size_t encodeTo(const BasicData<Allocator>& data,
+                         char* buffer,
+                         const std::size_t capacity,
+                         const bool whitespaces = false,
+                         const bool byteOrderMark = false)
+    {
+        const auto size = encodedSize(data, whitespaces, byteOrderMark);
+
+        if (size <= capacity)
+        {
+            PointerOutput output{buffer};
+            Encoder<Allocator>::encode(data, output, whitespaces, byteOrderMark);
+        }
+
+        return size;
+    }
+
+    // Passes the output to write(const char*, std::size_t) in chunks of a fixed-size buffer
+    // instead of collecting the whole document in memory
+    template <class Allocator, class Write,
+              std::enable_if_t<std::is_invocable_v<Write&, const char*, std::size_t>>* = nullptr>
+    void encode(const BasicData<Allocator>& data,
+                Write write,
+                const bool whitespaces = false,
+                const bool byteOrderMark = false)
+    {
+        BufferedOutput<Write> output{write};
+        Encoder<Allocator>::encode(data, output, whitespaces, byteOrderMark);
+        output.flush();
+    }
+
+    template <class Allocator>
+    void encode(const BasicData<Allocator>& data,
+                std::ostream& stream,
+                const bool whitespaces = false,
+                const bool byteOrderMark = false)
+    {
+        encode(data, [&stream](const char* buffer, const std::size_t size) {
+            if (!stream.write(buffer, static_cast<std::streamsize>(size)))
+                throw std::system_error{std::io_errc::stream, "Failed to write"};
+        }, whitespaces, byteOrderMark);
+    }
+
+    template <class Allocator>
+    void encode(const BasicData<Allocator>& data,
+                std::FILE* file,
+                const bool whitespaces = false,
+                const bool byteOrderMark = false)
+    {
+        encode(data, [file](const char* buffer, const std::size_t size) {
+            if (std::fwrite(buffer, 1, size, file) != size)
+                throw std::system_error{errno, std::generic_category(), "Failed to write"};
+        }, whitespaces, byteOrderMark);
+    }
+
+#if defined(XML_POSIX)
+    // A file descriptor to encode to, distinct from the flags
+    struct FileDescriptor final
+    {
+        int descriptor;
+    };
+
+    template <class Allocator>
+    void encode(const BasicData<Allocator>& data,
+                const FileDescriptor file,
+                const bool whitespaces = false,
+                const bool byteOrderMark = false)
+    {
+        encode(data, [file](const char* buffer, std::size_t size) {
+            while (size > 0)
+            {
+                if (const auto count = ::write(file.descriptor, buffer, size); count != -1)
+                {
+                    buffer += count;
+                    size -= static_cast<std::size_t>(count);
+                }
+                else if (errno != EINTR)
+                    throw std::system_error{errno, std::system_category(), "Failed to write"};
+            }
+        }, whitespaces, byteOrderMark);
     }
+#endif
 } // namespace xml
 
 #endif // XML_HPP
@@ -1,7 +1,17 @@
+#include <atomic>
+#include <cerrno>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <utility>
 #include <vector>
 #include "catch2/catch.hpp"
 #include "xml.hpp"
+#include "allocation_counter.hpp"
 
 TEST_CASE("Constuctor")
 {
@@ -174,6 +184,52 @@ TEST_CASE("New attribute", "[attributes]")
     REQUIRE(node["test"] == "test");
 }
 
+TEST_CASE("Attribute order", "[attributes]")
+{
+    const xml::Data d = xml::parse("<root z=\"1\" a=\"2\" m=\"3\"/>");
+
+    const auto& node = *d.begin();
+    std::vector<std::string> names;
+    for (const auto& [key, value] : node.getAttributes())
+        names.push_back(key);
+    REQUIRE(names == std::vector<std::string>{"z", "a", "m"});
+    REQUIRE(node["a"] == "2");
+
+    xml::Node copy = node;
+    copy["a"] = "4";
+    copy["b"] = "5";
+    REQUIRE(copy.getAttributes().size() == 4);
+
+    xml::Data encoded;
+    encoded.pushBack(copy);
+    REQUIRE(xml::encode(encoded) == "<root z=\"1\" a=\"4\" m=\"3\" b=\"5\"/>");
+}
+
+TEST_CASE("Wide attribute list", "[attributes]")
+{
+    // attributes are appended without a lookup, so a long list parses in linear time
+    std::string str = "<root";
+    for (std::size_t i = 0; i < 80000; ++i)
+        str += " a" + std::to_string(i) + "=\"" + std::to_string(i) + "\"";
+    str += "/>";
+
+    const xml::Data d = xml::parse(str);
+    const auto& node = *d.begin();
+    REQUIRE(node.getAttributes().size() == 80000);
+    REQUIRE(node["a79999"] == "79999");
+
+    const xml::DataView view = xml::parseView(str);
+    REQUIRE(view.begin()->getAttributes().size() == 80000);
+
+    // duplicates are rejected for short and long lists alike
+    REQUIRE_THROWS_AS(xml::parse("<root a=\"1\" b=\"2\" a=\"3\"/>"), xml::ParseError);
+    REQUIRE_THROWS_AS(xml::parseView("<root a=\"1\" a=\"1\"></root>"), xml::ParseError);
+    REQUIRE_THROWS_AS(xml::parse(str.substr(0, str.size() - 2) + " a40000=\"x\"/>"), xml::ParseError);
+
+    xml::Reader reader{"<root a=\"1\" a=\"2\"/>"};
+    REQUIRE_THROWS_AS(reader.next(), xml::ParseError);
+}
+
 TEST_CASE("EntityReferences", "[parsing]")
 {
     const xml::Data d = xml::parse("<root test=\"&lt;\">&gt;&amp;&apos;&quot;</root>", true, true, true);
@@ -383,6 +439,29 @@ TEST_CASE("Text encoding", "[encoding]")
     REQUIRE(xml::encode(d, true) == "<n>\n\ttext\n</n>\n");
 }
 
+TEST_CASE("Escaping", "[encoding]")
+{
+    xml::Data d;
+
+    xml::Node n(xml::Node::Type::tag);
+    n.setName("n");
+    n.setAttributes({{"a", "\"quoted\" & 'single' <tag>"}});
+
+    // long enough to cross several vector widths
+    const std::string text = std::string(40, 'x') + "<" + std::string(40, 'y') + "&'\">";
+    n.pushBack(xml::Node{text});
+
+    d.pushBack(n);
+
+    const auto encoded = xml::encode(d);
+    REQUIRE(encoded == "<n a=\"&quot;quoted&quot; &amp; &apos;single&apos; &lt;tag&gt;\">" +
+            std::string(40, 'x') + "&lt;" + std::string(40, 'y') + "&amp;&apos;&quot;&gt;</n>");
+
+    const xml::Data parsed = xml::parse(encoded);
+    REQUIRE(parsed.begin()->operator[]("a") == "\"quoted\" & 'single' <tag>");
+    REQUIRE(parsed.begin()->begin()->getValue() == text);
+}
+
 TEST_CASE("Nesting", "[encoding]")
 {
     xml::Data d;
@@ -543,6 +622,977 @@ TEST_CASE("Byte", "[byte]")
     REQUIRE(node.getName() == "r");
 }
 
+TEST_CASE("UTF-8", "[parsing]")
+{
+    const xml::Data d = xml::parse(std::string{"<\xC3\xBC\xE2\x82\xAC a=\"\xF0\x9F\x98\x80\">\xC3\xA9&#x20AC;</\xC3\xBC\xE2\x82\xAC>"});
+
+    const auto first = d.begin();
+    REQUIRE(first != d.end());
+
+    const auto& node = *first;
+    REQUIRE(node.getName() == "\xC3\xBC\xE2\x82\xAC");
+    REQUIRE(node["a"] == "\xF0\x9F\x98\x80");
+
+    const auto firstChild = node.begin();
+    REQUIRE(firstChild != node.end());
+    REQUIRE(firstChild->getValue() == "\xC3\xA9\xE2\x82\xAC");
+
+    REQUIRE_THROWS_AS(xml::parse("<\xE2\x82></\xE2\x82>"), xml::ParseError);
+    REQUIRE_THROWS_AS(xml::parse("<\x80/>"), xml::ParseError);
+}
+
+TEST_CASE("Non-contiguous input", "[parsing]")
+{
+    const std::string str = "<root a=\"1\">text</root>";
+    const std::list<char> data(str.begin(), str.end());
+
+    const xml::Data d = xml::parse(data);
+
+    const auto first = d.begin();
+    REQUIRE(first != d.end());
+
+    const auto& node = *first;
+    REQUIRE(node.getName() == "root");
+    REQUIRE(node["a"] == "1");
+    REQUIRE(node.begin()->getValue() == "text");
+}
+
+TEST_CASE("Long runs", "[parsing]")
+{
+    // delimiters land on every offset of the vector kernels
+    for (std::size_t length = 0; length < 80; ++length)
+    {
+        const std::string run(length, 'a');
+        const std::string spaces(length, ' ');
+
+        const xml::Data d = xml::parse(spaces + "<root" + spaces + " a='" + run + "&amp;" + run + "'>" +
+                                       run + "&lt;" + run +
+                                       "<!--" + run + "-->" +
+                                       "<![CDATA[" + run + "]" + run + "]]>" +
+                                       "</root>" + spaces, false, true, true);
+
+        const auto& node = *d.begin();
+        REQUIRE(node["a"] == run + "&" + run);
+
+        const auto& children = node.getChildren();
+        REQUIRE(children.size() == 3);
+        REQUIRE(children[0].getValue() == run + "<" + run);
+        REQUIRE(children[1].getValue() == run);
+        REQUIRE(children[2].getValue() == run + "]" + run);
+
+        REQUIRE_THROWS_AS(xml::parse("<root><!--" + run + "-"), xml::ParseError);
+        REQUIRE_THROWS_AS(xml::parse("<root><![CDATA[" + run + "]]"), xml::ParseError);
+        REQUIRE_THROWS_AS(xml::parse("<root a='" + run), xml::ParseError);
+    }
+}
+
+TEST_CASE("Deep nesting allocations", "[parsing]")
+{
+    const auto countAllocations = [](const std::size_t depth) {
+        std::string str;
+        for (std::size_t i = 0; i < depth; ++i) str += "<a>";
+        for (std::size_t i = 0; i < depth; ++i) str += "</a>";
+
+        const auto before = allocationCount.load();
+        const xml::Data d = xml::parse(str);
+        return allocationCount.load() - before;
+    };
+
+    // subtrees are moved into their parents, so the cost grows linearly with depth
+    const auto shallow = countAllocations(100);
+    const auto deep = countAllocations(400);
+    REQUIRE(deep <= 4 * shallow);
+}
+
+TEST_CASE("Emplace", "[nodes]")
+{
+    xml::Data data;
+    auto& node = data.emplaceBack(xml::Node::Type::tag);
+    node.setName("n");
+    node.emplaceBack("text");
+    node.pushBack(xml::Node{"more"});
+
+    REQUIRE(data.getChildren().size() == 1);
+    REQUIRE(data.begin()->getName() == "n");
+    REQUIRE(data.begin()->getChildren().size() == 2);
+    REQUIRE(data.begin()->getChildren()[0].getValue() == "text");
+    REQUIRE(data.begin()->getChildren()[1].getValue() == "more");
+}
+
+TEST_CASE("View", "[view]")
+{
+    const std::string str = "<!--c--><root a=\"1\" b=\"&lt;2\">text<c>&amp;t</c><![CDATA[d]]></root>";
+    xml::DataView d = xml::parseView(str, false, true);
+
+    const auto isInInput = [&str](const std::string_view value) {
+        return value.data() >= str.data() && value.data() + value.size() <= str.data() + str.size();
+    };
+
+    REQUIRE(d.getChildren().size() == 2);
+    REQUIRE(d.getChildren()[0].getType() == xml::NodeView::Type::comment);
+    REQUIRE(d.getChildren()[0].getValue() == "c");
+
+    const auto& node = d.getChildren()[1];
+    REQUIRE(node.getType() == xml::NodeView::Type::tag);
+    REQUIRE(node.getName() == "root");
+    REQUIRE(isInInput(node.getName()));
+
+    REQUIRE(node.getAttributes().size() == 2);
+    REQUIRE(node["a"] == "1");
+    REQUIRE(isInInput(node["a"]));
+    REQUIRE(node["b"] == "<2");
+    REQUIRE(!isInInput(node["b"]));
+    REQUIRE_THROWS_AS(node["c"], xml::RangeError);
+
+    const auto& children = node.getChildren();
+    REQUIRE(children.size() == 3);
+    REQUIRE(children[0].getValue() == "text");
+    REQUIRE(isInInput(children[0].getValue()));
+    REQUIRE(children[1].getName() == "c");
+    REQUIRE(children[1].begin()->getValue() == "&t");
+    REQUIRE(children[2].getType() == xml::NodeView::Type::characterData);
+    REQUIRE(children[2].getValue() == "d");
+
+    // decoded values survive moving the document
+    const xml::DataView moved = std::move(d);
+    REQUIRE(moved.getChildren()[1]["b"] == "<2");
+
+    REQUIRE_THROWS_AS(xml::parseView("<root>"), xml::ParseError);
+}
+
+#if defined(__cpp_lib_memory_resource)
+TEST_CASE("Memory resource", "[pmr]")
+{
+    std::vector<std::byte> storage(16384);
+    std::pmr::monotonic_buffer_resource arena{storage.data(), storage.size(), std::pmr::null_memory_resource()};
+
+    const std::string_view str = "<root attribute=\"a value longer than the small string buffer\">"
+        "<child>a text node longer than the small string buffer</child>"
+        "</root>";
+
+    const auto globalAllocations = [&arena](const std::string_view data) {
+        const auto before = allocationCount.load();
+        const xml::pmr::Data document = xml::parse(data, &arena);
+        return allocationCount.load() - before;
+    };
+
+    std::string wide = "<root>";
+    for (int i = 0; i < 16; ++i)
+        wide += "<child attribute=\"a value longer than the small string buffer\">a text node longer than the small string buffer</child>";
+    wide += "</root>";
+
+    // the document is allocated from the arena, only the parser's scratch state comes from the global heap
+    REQUIRE(globalAllocations(wide) == globalAllocations(str));
+
+    const xml::pmr::Data d = xml::parse(str, &arena);
+
+    const auto& node = *d.begin();
+    REQUIRE(node.get_allocator().resource() == &arena);
+    REQUIRE(node["attribute"] == "a value longer than the small string buffer");
+
+    const auto& child = node.getChildren()[0];
+    REQUIRE(child.get_allocator().resource() == &arena);
+    REQUIRE(child.begin()->getValue() == "a text node longer than the small string buffer");
+
+    REQUIRE(xml::encode(d) == "<root attribute=\"a value longer than the small string buffer\">"
+        "<child>a text node longer than the small string buffer</child>"
+        "</root>");
+}
+#endif
+
+TEST_CASE("Handler", "[sax]")
+{
+    struct Recorder final: xml::Handler
+    {
+        void startElement(const std::string_view name, const xml::AttributesView& attributes)
+        {
+            events.push_back("<" + std::string{name});
+            for (const auto& [key, value] : attributes)
+                events.push_back(std::string{key} + "=" + std::string{value});
+        }
+
+        void endElement(const std::string_view name) { events.push_back("/" + std::string{name}); }
+        void text(const std::string_view value) { events.push_back("'" + std::string{value}); }
+        void comment(const std::string_view value) { events.push_back("!" + std::string{value}); }
+
+        std::vector<std::string> events;
+    };
+
+    Recorder recorder;
+    xml::parse("<?xml version=\"1.0\"?><!--c--><a x=\"1 &amp; 2\" y='&lt;'><b/>t &gt; u<![CDATA[d]]></a>",
+               recorder, false, true, false);
+
+    const std::vector<std::string> expected{"!c", "<a", "x=1 & 2", "y=<", "<b", "/b", "'t > u", "/a"};
+    REQUIRE(recorder.events == expected);
+
+    // callbacks that are not hidden are ignored
+    struct Counter final: xml::Handler
+    {
+        void startElement(std::string_view, const xml::AttributesView&) { ++elements; }
+        std::size_t elements = 0;
+    };
+
+    Counter counter;
+    xml::parse(std::string{"<a><b><c/></b><d/></a>"}, counter);
+    REQUIRE(counter.elements == 4);
+
+    REQUIRE_THROWS_AS(xml::parse("<a></b>", counter), xml::ParseError);
+    REQUIRE_THROWS_AS(xml::parse("<a/><b/>", counter), xml::ParseError);
+}
+
+TEST_CASE("Reader", "[pull]")
+{
+    using Token = xml::Reader::Token;
+
+    xml::Reader reader{"<?xml version=\"1.0\"?><!--c--><a x=\"1 &amp; 2\"><b><c/>skipped</b>t<d/></a>",
+                       false, true, false};
+
+    REQUIRE(reader.next() == Token::comment);
+    REQUIRE(reader.getValue() == "c");
+
+    REQUIRE(reader.next() == Token::startElement);
+    REQUIRE(reader.getName() == "a");
+    REQUIRE(reader["x"] == "1 & 2");
+    REQUIRE(reader.getDepth() == 1);
+
+    REQUIRE(reader.next() == Token::startElement);
+    REQUIRE(reader.getName() == "b");
+    reader.skipSubtree();
+    REQUIRE(reader.getToken() == Token::endElement);
+
+    REQUIRE(reader.next() == Token::text);
+    REQUIRE(reader.getValue() == "t");
+
+    REQUIRE(reader.next() == Token::startElement);
+    REQUIRE(reader.getName() == "d");
+    REQUIRE(reader.getAttributes().empty());
+    REQUIRE(reader.next() == Token::endElement);
+    REQUIRE(reader.getName() == "d");
+
+    REQUIRE(reader.next() == Token::endElement);
+    REQUIRE(reader.getName() == "a");
+    REQUIRE(reader.getDepth() == 0);
+
+    REQUIRE(reader.next() == Token::end);
+
+    xml::Reader mismatched{"<a></b>"};
+    REQUIRE(mismatched.next() == Token::startElement);
+    REQUIRE_THROWS_AS(mismatched.next(), xml::ParseError);
+
+    xml::Reader unclosed{"<a>"};
+    REQUIRE(unclosed.next() == Token::startElement);
+    REQUIRE_THROWS_AS(unclosed.next(), xml::ParseError);
+}
+
+TEST_CASE("Push parser", "[push]")
+{
+    struct Recorder final: xml::Handler
+    {
+        void startElement(const std::string_view name, const xml::AttributesView& attributes)
+        {
+            events.push_back("<" + std::string{name});
+            for (const auto& [key, value] : attributes)
+                events.push_back(std::string{key} + "=" + std::string{value});
+        }
+
+        void endElement(const std::string_view name) { events.push_back("/" + std::string{name}); }
+        void text(const std::string_view value) { events.push_back("'" + std::string{value}); }
+        void characterData(const std::string_view value) { events.push_back("[" + std::string{value}); }
+        void comment(const std::string_view value) { events.push_back("!" + std::string{value}); }
+        void processingInstruction(const std::string_view name, const std::string_view value)
+        {
+            events.push_back("?" + std::string{name} + " " + std::string{value});
+        }
+        void startDocumentTypeDefinition(const std::string_view name, const std::string_view)
+        {
+            events.push_back("D" + std::string{name});
+        }
+        void declaration(xml::Node::Type, const std::string_view name) { events.push_back("E" + std::string{name}); }
+
+        std::vector<std::string> events;
+    };
+
+    const std::string str = "\xEF\xBB\xBF<?xml version=\"1.0\"?><!DOCTYPE r [<!ELEMENT r ANY>]>"
+        "<r><!-- a comment --><\xC3\xA4\xE2\x82\xAC a=\"x > y\" b='&lt;&#x20AC;'>"
+        "text &amp; more \xF0\x9F\x98\x80<![CDATA[<data>]]></\xC3\xA4\xE2\x82\xAC><?pi value?><e/></r>";
+
+    Recorder expected;
+    xml::parse(str, expected, false, true, true);
+
+    for (std::size_t chunkSize = 1; chunkSize <= str.size(); ++chunkSize)
+    {
+        Recorder recorder;
+        xml::PushParser parser{recorder, false, true, true};
+
+        for (std::size_t offset = 0; offset < str.size(); offset += chunkSize)
+            parser.feed(str.data() + offset, std::min(chunkSize, str.size() - offset));
+
+        parser.finish();
+        REQUIRE(recorder.events == expected.events);
+    }
+
+    // brackets inside the literals of a document type definition do not end it,
+    // and parts of terminators split across chunks are found when the scan resumes
+    for (const std::string literals : {"<!DOCTYPE r [<!ENTITY e \"a]b\">]><r/>", "<!DOCTYPE r SYSTEM \"a[b.dtd\"><r/>",
+                                       "<!DOCTYPE x SYSTEM \"a>b\"><x/>", "<!DOCTYPE r PUBLIC 'a>' \"b>\"><r/>",
+                                       "<!DOCTYPE r [<!ENTITY e \"a>b\"><!ATTLIST r a CDATA '>'>]><r/>",
+                                       "<r a='x\">' b=\"y'>\"><![CDATA[a]]b]]]]]></r><?pi a>b?>"})
+    {
+        Recorder whole;
+        xml::parse(literals, whole);
+
+        for (std::size_t chunkSize = 1; chunkSize <= literals.size(); ++chunkSize)
+        {
+            Recorder recorder;
+            xml::PushParser parser{recorder};
+
+            for (std::size_t offset = 0; offset < literals.size(); offset += chunkSize)
+                parser.feed(literals.data() + offset, std::min(chunkSize, literals.size() - offset));
+
+            parser.finish();
+            REQUIRE(recorder.events == whole.events);
+        }
+    }
+
+    Recorder recorder;
+    xml::PushParser parser{recorder};
+    parser.feed("<a><b>");
+    REQUIRE(recorder.events.size() == 2);
+    REQUIRE_THROWS_AS(parser.finish(), xml::ParseError);
+
+    // the parser is reset by finish
+    parser.feed("<c/>");
+    parser.finish();
+    REQUIRE(recorder.events.back() == "/c");
+
+    // errors are reported as soon as the offending token is complete
+    REQUIRE_THROWS_AS(parser.feed("<a></b>"), xml::ParseError);
+
+    // the document that failed is discarded, whether the error is found by feed or by finish
+    parser.feed("<d/>");
+    parser.finish();
+    REQUIRE(recorder.events.back() == "/d");
+
+    parser.feed("<a></b");
+    REQUIRE_THROWS_AS(parser.finish(), xml::ParseError);
+    parser.feed("<e/>");
+    parser.finish();
+    REQUIRE(recorder.events.back() == "/e");
+}
+
+TEST_CASE("Push parser large tokens", "[push]")
+{
+    struct Counter final: xml::Handler
+    {
+        void characterData(const std::string_view value) { size += value.size(); }
+        void comment(const std::string_view value) { size += value.size(); }
+        void processingInstruction(const std::string_view, const std::string_view value) { size += value.size(); }
+        void startElement(const std::string_view, const xml::AttributesView& attributes)
+        {
+            for (const auto& attribute : attributes)
+                size += attribute.second.size();
+        }
+
+        std::size_t size = 0;
+    };
+
+    const std::string content(1024 * 1024, 'x');
+    for (const auto& [begin, end] : {std::pair{"<r><![CDATA[", "]]></r>"},
+                                     std::pair{"<r><!--", "--></r>"},
+                                     std::pair{"<r><?pi ", "?></r>"},
+                                     std::pair{"<r a=\"", "\"/>"}})
+    {
+        const auto str = begin + content + end;
+
+        Counter counter;
+        xml::PushParser parser{counter, false, true, true};
+
+        for (std::size_t offset = 0; offset < str.size(); offset += 1024)
+            parser.feed(str.data() + offset, std::min(std::size_t{1024}, str.size() - offset));
+        parser.finish();
+
+        REQUIRE(counter.size == content.size());
+    }
+
+    // each chunk of a token is scanned from where the scan of the previous ones stopped, at most two bytes back
+    for (const auto& [begin, end] : {std::pair{"<![CDATA[", "]]>"},
+                                     std::pair{"<!--", "-->"},
+                                     std::pair{"<?pi ", "?>"},
+                                     std::pair{"<r a=\"", "\"/>"},
+                                     std::pair{"<!DOCTYPE r [<!ENTITY e '", "'>]>"}})
+    {
+        const auto token = begin + content + end;
+
+        xml::ScanState state;
+        for (std::size_t size = 1024; size < token.size(); size += 1024)
+        {
+            REQUIRE(xml::findMarkupEnd(token.data(), token.data() + size, state) == nullptr);
+            REQUIRE(state.position + 2 >= size);
+        }
+
+        REQUIRE(xml::findMarkupEnd(token.data(), token.data() + token.size(), state) == token.data() + token.size());
+    }
+}
+
+TEST_CASE("File", "[file]")
+{
+    const std::string str = "\xEF\xBB\xBF<root a=\"&lt;\">text</root>";
+
+    const std::string path = "file_test.xml";
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    REQUIRE(file != nullptr);
+    std::fwrite(str.data(), 1, str.size(), file);
+    std::fclose(file);
+
+    const xml::Data d = xml::parseFile(path);
+    std::remove(path.c_str());
+
+    const auto& node = *d.begin();
+    REQUIRE(node.getName() == "root");
+    REQUIRE(node["a"] == "<");
+    REQUIRE(node.begin()->getValue() == "text");
+
+    REQUIRE_THROWS_AS(xml::parseFile("missing.xml"), std::system_error);
+
+#if defined(__linux__)
+    // pipes can not be mapped, so they are read in chunks
+    const auto parsePipe = [](const std::string& content) {
+        int descriptors[2];
+        REQUIRE(::pipe(descriptors) == 0);
+
+        // the content can be larger than the pipe buffer, so it is written while the file is parsed
+        std::thread writer{[&content, descriptor = descriptors[1]]() {
+            for (std::size_t offset = 0; offset < content.size();)
+                if (const auto count = ::write(descriptor, content.data() + offset, content.size() - offset); count > 0)
+                    offset += static_cast<std::size_t>(count);
+                else if (errno != EINTR)
+                    break;
+            ::close(descriptor);
+        }};
+
+        struct Closer final
+        {
+            ~Closer() { ::close(descriptor); writer.join(); }
+            int descriptor;
+            std::thread& writer;
+        } closer{descriptors[0], writer};
+
+        return xml::parseFile("/dev/fd/" + std::to_string(descriptors[0]));
+    };
+
+    const xml::Data piped = parsePipe(str);
+    REQUIRE(piped.begin()->getName() == "root");
+    REQUIRE((*piped.begin())["a"] == "<");
+
+    // a file parses the same however it is read
+    const std::string definition = "<!DOCTYPE r [<!ENTITY e \"a]b\">]><r>text</r>";
+    REQUIRE(xml::encode(parsePipe(definition)) == xml::encode(xml::parse(definition)));
+
+    // a character data section and a comment longer than many read chunks, whose resumed scan is checked
+    // by the push parser tests
+    const std::string content(4 * 1024 * 1024 + 1, 'x');
+    const std::string large = "<r><![CDATA[" + content + "]]><!--" + content + "--></r>";
+    const xml::Data pipedLarge = parsePipe(large);
+    REQUIRE(pipedLarge.begin()->begin()->getType() == xml::Node::Type::characterData);
+    REQUIRE(pipedLarge.begin()->begin()->getValue() == content);
+#endif
+}
+
+TEST_CASE("Encode to sink", "[encoding]")
+{
+    xml::Data data;
+    xml::Node root{xml::Node::Type::tag};
+    root.setName("root");
+    for (std::size_t i = 0; i < 1000; ++i)
+    {
+        xml::Node child{xml::Node::Type::tag};
+        child.setName("child");
+        child["index"] = std::to_string(i);
+        child.pushBack(xml::Node{std::string(i % 10, 'x') + "<&>"});
+        root.pushBack(std::move(child));
+    }
+    root.pushBack(xml::Node{std::string(10000, 'y')}); // longer than the buffer
+    data.pushBack(std::move(root));
+
+    const auto expected = xml::encode(data, true, true);
+
+    std::string written;
+    std::size_t writes = 0;
+    xml::encode(data, [&written, &writes](const char* buffer, const std::size_t size) {
+        written.append(buffer, size);
+        ++writes;
+    }, true, true);
+    REQUIRE(written == expected);
+    REQUIRE(writes > 1);
+
+    std::ostringstream stream;
+    xml::encode(data, stream, true, true);
+    REQUIRE(stream.str() == expected);
+
+    // a stream that does not accept the output is reported like a file that does not
+    std::ostringstream failedStream;
+    failedStream.setstate(std::ios::badbit);
+    REQUIRE_THROWS_AS(xml::encode(data, failedStream), std::system_error);
+
+    std::FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    xml::encode(data, file, true, true);
+    REQUIRE(static_cast<std::size_t>(std::ftell(file)) == expected.size());
+    std::fclose(file);
+
+#if defined(XML_POSIX)
+    std::FILE* descriptorFile = std::tmpfile();
+    REQUIRE(descriptorFile != nullptr);
+    xml::encode(data, xml::FileDescriptor{fileno(descriptorFile)}, true, true);
+
+    std::rewind(descriptorFile);
+    std::string read(expected.size() + 1, '\0');
+    read.resize(std::fread(read.data(), 1, read.size(), descriptorFile));
+    REQUIRE(read == expected);
+    std::fclose(descriptorFile);
+#endif
+}
+
+TEST_CASE("Encode to buffer", "[encoding]")
+{
+    const xml::Data data = xml::parse("<!DOCTYPE r [<!ELEMENT r ANY>]><r a=\"1\"><!--c--><b>&lt;&amp;&quot;</b><![CDATA[d]]><e/></r>",
+                                      false, true, true);
+
+    for (const bool whitespaces : {false, true})
+        for (const bool byteOrderMark : {false, true})
+            REQUIRE(xml::encodedSize(data, whitespaces, byteOrderMark) == xml::encode(data, whitespaces, byteOrderMark).size());
+
+    const auto expected = xml::encode(data, true);
+
+    std::vector<char> buffer(expected.size() - 1, '\0');
+    REQUIRE(xml::encodeTo(data, buffer.data(), buffer.size(), true) == expected.size());
+    REQUIRE(buffer == std::vector<char>(expected.size() - 1, '\0')); // nothing is written
+
+    buffer.resize(expected.size());
+
+    const auto before = allocationCount.load();
+    REQUIRE(xml::encodeTo(data, buffer.data(), buffer.size(), true) == expected.size());
+    REQUIRE(allocationCount.load() == before);
+
+    REQUIRE(std::string(buffer.begin(), buffer.end()) == expected);
+}
+
+TEST_CASE("Flat", "[flat]")
+{
+    const std::string str = "<!DOCTYPE r [<!ELEMENT r ANY>]><r b=\"2\" a=\"&lt;1\"><!--c--><x>t &amp; u</x><y/><![CDATA[d]]></r>";
+    const xml::FlatData d = xml::parseFlat(str, false, true, true);
+
+    REQUIRE(d.size() == 8);
+
+    auto iterator = d.begin();
+    const auto doctype = *iterator;
+    REQUIRE(doctype.getType() == xml::FlatNode::Type::documentTypeDefinition);
+    REQUIRE(doctype.getName() == "r");
+    REQUIRE((*doctype.begin()).getType() == xml::FlatNode::Type::element);
+
+    const auto root = *++iterator;
+    REQUIRE(++iterator == d.end());
+    REQUIRE(root.getName() == "r");
+    REQUIRE_FALSE(root.hasParent());
+
+    // attributes keep the document order
+    std::vector<std::pair<std::string_view, std::string_view>> attributes;
+    for (const auto& attribute : root.getAttributes())
+        attributes.push_back(attribute);
+    REQUIRE(attributes == std::vector<std::pair<std::string_view, std::string_view>>{{"b", "2"}, {"a", "<1"}});
+    REQUIRE(root["a"] == "<1");
+    REQUIRE_THROWS_AS(root["c"], xml::RangeError);
+
+    std::vector<xml::FlatNode::Type> types;
+    for (const auto child : root)
+    {
+        types.push_back(child.getType());
+        REQUIRE(child.getParent().getIndex() == root.getIndex());
+    }
+    REQUIRE(types == std::vector<xml::FlatNode::Type>{xml::FlatNode::Type::comment,
+                                                      xml::FlatNode::Type::tag,
+                                                      xml::FlatNode::Type::tag,
+                                                      xml::FlatNode::Type::characterData});
+
+    // nodes are numbered in document order
+    REQUIRE(d[4].getName() == "x");
+    REQUIRE(d[5].getValue() == "t & u");
+    REQUIRE(d[5].getParent().getName() == "x");
+    REQUIRE(d[6].getChildren().empty());
+    REQUIRE_THROWS_AS(d[8], xml::RangeError);
+
+    REQUIRE_THROWS_AS(xml::parseFlat("<a></b>"), xml::ParseError);
+}
+
+TEST_CASE("Atoms", "[flat]")
+{
+    const xml::FlatData d = xml::parseFlat("<list><item id=\"1\"/><item id=\"2\"/><item id=\"3\"/></list>");
+
+    // list, item and id are stored once
+    REQUIRE(d.getAtoms().size() == 3);
+
+    const auto item = d.getAtoms().intern("item");
+    std::size_t items = 0;
+    for (const auto child : *d.begin())
+    {
+        if (child.getName().data() == item.data()) ++items;
+        REQUIRE((*child.getAttributes().begin()).first.data() == d.getAtoms().intern("id").data());
+    }
+    REQUIRE(items == 3);
+
+    // documents can share a table, also between threads
+    const auto atoms = std::make_shared<xml::AtomTable>(true);
+    std::vector<xml::FlatData> documents(4);
+    std::vector<std::thread> threads;
+    for (auto& document : documents)
+        threads.emplace_back([&document, &atoms]() {
+            for (int i = 0; i < 100; ++i)
+                document = xml::parseFlat("<a><b c=\"d\"/><e/></a>", atoms);
+        });
+    for (auto& thread : threads) thread.join();
+
+    REQUIRE(atoms->size() == 4);
+    for (const auto& document : documents)
+        REQUIRE((*document.begin()).getName().data() == (*documents.front().begin()).getName().data());
+
+    // a DataView can intern its names too, and keeps the table alive
+    const std::string str = "<list><item id=\"1\"/><item id=\"2\">text</item></list>";
+    const xml::DataView view = xml::parseView(str, std::make_shared<xml::AtomTable>());
+    REQUIRE(view.getAtoms() != nullptr);
+    REQUIRE(view.getAtoms()->size() == 3);
+    const auto& list = view.getChildren().front();
+    REQUIRE(list.getName() == "list");
+    for (const auto& child : list)
+    {
+        REQUIRE(child.getName().data() == view.getAtoms()->intern("item").data());
+        REQUIRE(child.getAttributes().front().first.data() == view.getAtoms()->intern("id").data());
+    }
+    REQUIRE(list.getChildren().back().getChildren().front().getValue().data() == str.data() + str.find("text"));
+    REQUIRE(xml::parseView(str).getAtoms() == nullptr);
+}
+
+TEST_CASE("Depth limit", "[parsing]")
+{
+    const auto nested = [](const std::size_t depth) {
+        std::string str;
+        for (std::size_t i = 0; i < depth; ++i) str += "<a>";
+        for (std::size_t i = 0; i < depth; ++i) str += "</a>";
+        return str;
+    };
+
+    struct Counter final: xml::Handler
+    {
+        void startElement(std::string_view, const xml::AttributesView&) { ++elements; }
+        std::size_t elements = 0;
+    };
+
+    // open elements are kept on the heap, so the depth is not bounded by the stack
+    Counter counter;
+    xml::parse(nested(100000), counter, false, false, false, 100000);
+    REQUIRE(counter.elements == 100000);
+
+    const xml::FlatData d = xml::parseFlat(nested(100000), false, false, false, 100000);
+    REQUIRE(d.size() == 100000);
+
+    REQUIRE_NOTHROW(xml::parse(nested(xml::defaultMaxDepth)));
+    REQUIRE_THROWS_AS(xml::parse(nested(xml::defaultMaxDepth + 1)), xml::ParseError);
+    REQUIRE_THROWS_AS(xml::parse(nested(3), false, false, false, 2), xml::ParseError);
+    REQUIRE_NOTHROW(xml::parse("<a><b/></a>", false, false, false, 2));
+
+    xml::Reader reader{"<a><b><c/></b></a>", false, false, false, 2};
+    REQUIRE(reader.next() == xml::Reader::Token::startElement);
+    REQUIRE(reader.next() == xml::Reader::Token::startElement);
+    REQUIRE_THROWS_AS(reader.next(), xml::ParseError);
+
+    // a skipped subtree is counted from the root of the document
+    xml::Reader skipping{"<r><a><b><c/></b></a></r>", false, false, false, 3};
+    REQUIRE(skipping.next() == xml::Reader::Token::startElement);
+    REQUIRE(skipping.next() == xml::Reader::Token::startElement);
+    REQUIRE_THROWS_AS(skipping.skipSubtree(), xml::ParseError);
+
+    xml::Reader shallow{"<r><a><b/></a></r>", false, false, false, 3};
+    REQUIRE(shallow.next() == xml::Reader::Token::startElement);
+    REQUIRE(shallow.next() == xml::Reader::Token::startElement);
+    REQUIRE_NOTHROW(shallow.skipSubtree());
+
+    xml::PushParser<Counter> parser{counter, false, false, false, 2};
+    REQUIRE_THROWS_AS(parser.feed("<a><b><c/></b></a>"), xml::ParseError);
+}
+
+TEST_CASE("Flags", "[parsing]")
+{
+    const std::string str = "<a> <!--c--><?p v?></a>";
+
+    const xml::Data none = xml::parse<xml::Flags::none>(str);
+    REQUIRE(none.begin()->getChildren().empty());
+    REQUIRE(xml::encode(none) == xml::encode(xml::parse(str)));
+
+    const xml::Data all = xml::parse<xml::Flags::preserveWhiteSpaces |
+        xml::Flags::preserveComments |
+        xml::Flags::preserveProcessingInstructions>(str.c_str());
+    REQUIRE(xml::encode(all) == xml::encode(xml::parse(str, true, true, true)));
+    REQUIRE(all.begin()->getChildren().size() == 3);
+
+    const xml::DataView view = xml::parseView<xml::Flags::preserveComments>(str);
+    REQUIRE(view.begin()->getChildren().size() == 1);
+    REQUIRE(view.begin()->begin()->getType() == xml::NodeView::Type::comment);
+
+    struct Counter final: xml::Handler
+    {
+        void comment(std::string_view) { ++comments; }
+        void processingInstruction(std::string_view, std::string_view) { ++instructions; }
+        std::size_t comments = 0;
+        std::size_t instructions = 0;
+    };
+
+    Counter counter;
+    xml::parse<xml::Flags::preserveProcessingInstructions>(str, counter);
+    REQUIRE(counter.comments == 0);
+    REQUIRE(counter.instructions == 1);
+}
+
+TEST_CASE("Projection", "[parsing]")
+{
+    const std::string str = "<?xml version=\"1.0\"?>"
+        "<feed><title>t</title>"
+        "<entry k=\"1\"><id>1</id><updated>u1</updated><content>c<b>d</b></content></entry>"
+        "<entry k=\"2\"><id>2</id><content>x</content><updated>u2</updated></entry>"
+        "<other><id>3</id></other></feed>";
+
+    const xml::Data d = xml::parse(str, xml::Projection{"/feed/entry/id", "/feed/entry/updated"});
+    REQUIRE(xml::encode(d) == "<feed>"
+            "<entry k=\"1\"><id>1</id><updated>u1</updated></entry>"
+            "<entry k=\"2\"><id>2</id><updated>u2</updated></entry></feed>");
+
+    // the whole subtree of a matching element is kept
+    const xml::Data all = xml::parse(str.c_str(), xml::Projection{"/feed/*/content"});
+    REQUIRE(xml::encode(all) == "<feed><title/>"
+            "<entry k=\"1\"><content>c<b>d</b></content></entry>"
+            "<entry k=\"2\"><content>x</content></entry><other/></feed>");
+
+    const std::vector<std::string> paths{"/feed/other", "/rss"};
+    const xml::Data other = xml::parse(str, xml::Projection{paths.begin(), paths.end()});
+    REQUIRE(xml::encode(other) == "<feed><other><id>3</id></other></feed>");
+
+    const xml::Data empty = xml::parse(str, xml::Projection{"/rss/channel"});
+    REQUIRE(empty.begin() == empty.end());
+
+    // discarded subtrees are still checked
+    REQUIRE_THROWS_AS(xml::parse("<a><b><c></b></a>", xml::Projection{"/a/d"}), xml::ParseError);
+    REQUIRE_THROWS_AS(xml::Projection{"a/b"}, xml::ParseError);
+    REQUIRE_THROWS_AS(xml::Projection{"/a//b"}, xml::ParseError);
+
+    // nothing is allocated for discarded elements
+    const auto countAllocations = [](const std::size_t entries) {
+        std::string feed = "<feed>";
+        for (std::size_t i = 0; i < entries; ++i)
+            feed += "<entry><content type=\"text\">long &amp; discarded text</content></entry>";
+        feed += "<id>1</id></feed>";
+
+        const auto before = allocationCount.load();
+        const xml::Data result = xml::parse(feed, xml::Projection{"/feed/id"});
+        return allocationCount.load() - before;
+    };
+    REQUIRE(countAllocations(1000) == countAllocations(10));
+}
+
+TEST_CASE("Query", "[query]")
+{
+    const xml::Data d = xml::parse("<routes>"
+                                   "<route id=\"a\" method=\"get\"><target>x</target></route>"
+                                   "<route id=\"b\" method=\"post\"><target>y</target><target>z</target></route>"
+                                   "<group><route id=\"c\"><target><![CDATA[w]]></target></route></group>"
+                                   "</routes>");
+
+    const auto ids = [](const auto& nodes) {
+        std::vector<std::string> result;
+        for (const auto node : nodes) result.push_back(node->getType() == xml::Node::Type::tag ?
+                                                       (*node)["id"] : node->getValue());
+        return result;
+    };
+
+    REQUIRE(ids(xml::Query{"/routes/route"}.select(d)) == std::vector<std::string>{"a", "b"});
+    REQUIRE(ids(xml::Query{"//route"}.select(d)) == std::vector<std::string>{"a", "b", "c"});
+    REQUIRE(ids(xml::Query{"routes/*/route"}.select(d)) == std::vector<std::string>{"c"});
+    REQUIRE(ids(xml::Query{"/routes/route[2]"}.select(d)) == std::vector<std::string>{"b"});
+    REQUIRE(ids(xml::Query{"/routes/route[last()]"}.select(d)) == std::vector<std::string>{"b"});
+    REQUIRE(ids(xml::Query{"//route[@method]"}.select(d)) == std::vector<std::string>{"a", "b"});
+    REQUIRE(ids(xml::Query{"//route[@method='post']"}.select(d)) == std::vector<std::string>{"b"});
+    REQUIRE(ids(xml::Query{"//route[ @method = \"get\" ][1]"}.select(d)) == std::vector<std::string>{"a"});
+    REQUIRE(ids(xml::Query{"//target/text()"}.select(d)) == std::vector<std::string>{"x", "y", "z", "w"});
+    REQUIRE(ids(xml::Query{"//route/target[1]/text()"}.select(d)) == std::vector<std::string>{"x", "y", "w"});
+    REQUIRE(ids(xml::Query{"//*//target/text()"}.select(d)) == std::vector<std::string>{"x", "y", "z", "w"});
+    REQUIRE(xml::Query{"/route"}.select(d).empty());
+    REQUIRE(xml::Query{"/routes/route[3]"}.select(d).empty());
+
+    // the children of nested context nodes are returned in document order
+    const xml::Data nested = xml::parse("<r><a><a><b>inner</b></a><b>outer</b></a></r>");
+    REQUIRE(ids(xml::Query{"//a/b/text()"}.select(nested)) == std::vector<std::string>{"inner", "outer"});
+    const auto b = xml::Query{"//a/b"}.select(nested);
+    REQUIRE(b.size() == 2);
+    REQUIRE(b[0]->begin()->getValue() == "inner");
+    REQUIRE(b[1]->begin()->getValue() == "outer");
+
+    // relative to a node
+    const xml::Query query{"target[last()]/text()"};
+    REQUIRE(ids(query.select(d.begin()->getChildren()[1])) == std::vector<std::string>{"z"});
+
+    REQUIRE_THROWS_AS(xml::Query{""}, xml::ParseError);
+    REQUIRE_THROWS_AS(xml::Query{"/a/"}, xml::ParseError);
+    REQUIRE_THROWS_AS(xml::Query{"/a[0]"}, xml::ParseError);
+    REQUIRE_THROWS_AS(xml::Query{"/a[@b='c]"}, xml::ParseError);
+    REQUIRE_THROWS_AS(xml::Query{"/a[first()]"}, xml::ParseError);
+}
+
+TEST_CASE("Index", "[index]")
+{
+    xml::Data d = xml::parse("<config>"
+                             "<service id=\"auth\"><host>a</host></service>"
+                             "<service xml:id=\"billing\"><host>b</host></service>"
+                             "<group><service id=\"auth\"/><host>c</host></group>"
+                             "</config>");
+
+    const xml::Index index{d, true};
+    REQUIRE(index.getElementById("auth") == &d.begin()->getChildren()[0]);
+    REQUIRE(index.getElementById("billing") == &d.begin()->getChildren()[1]);
+    REQUIRE(index.getElementById("none") == nullptr);
+
+    const auto& hosts = index.getElementsByTagName("host");
+    REQUIRE(hosts.size() == 3);
+    REQUIRE(hosts[2]->begin()->getValue() == "c");
+    REQUIRE(index.getElementsByTagName("none").empty());
+
+    xml::Index ids{d, false, {"name"}};
+    REQUIRE(ids.getElementById("auth") == nullptr);
+    REQUIRE_THROWS_AS(ids.getElementsByTagName("host"), xml::RangeError);
+
+    // the index has to be rebuilt after the document changes
+    auto& service = d.begin()->emplaceBack(xml::Node::Type::tag);
+    service.setName("service");
+    service["name"] = "new";
+    ids.rebuild(d);
+    REQUIRE(ids.getElementById("new") == &d.begin()->getChildren().back());
+}
+
+TEST_CASE("Parallel", "[parallel]")
+{
+    std::string str = "<?xml version=\"1.0\"?><!DOCTYPE catalogue [<!ENTITY e \"x\">]><catalogue version=\"1\">";
+    for (int i = 0; i < 5000; ++i)
+        str += "<item id=\"" + std::to_string(i) + "\" note=\"a > b\">\n"
+            "  <name>Item &amp; " + std::to_string(i) + "</name>\n"
+            "  <!-- <item id=\"fake\"> --><![CDATA[</catalogue><x>]]><empty/>\n"
+            "</item>text " + std::to_string(i) + "\n";
+    str += "</catalogue><!-- end -->";
+
+    for (const bool preserve : {false, true})
+    {
+        const xml::Data expected = xml::parse(str, preserve, preserve, preserve);
+        const xml::Data d = xml::parseParallel(str, 4, preserve, preserve, preserve);
+        REQUIRE(xml::encode(d) == xml::encode(expected));
+    }
+
+    REQUIRE(xml::encode(xml::parseParallel(str.c_str(), 1)) == xml::encode(xml::parse(str)));
+    REQUIRE(xml::encode(xml::parseParallel("<a><b/></a>", 4)) == "<a><b/></a>");
+
+    // errors inside a part are reported as by parse
+    std::string broken = str;
+    broken.replace(broken.find("<item id=\"4000\""), 5, "<item<");
+    REQUIRE_THROWS_AS(xml::parseParallel(broken, 4), xml::ParseError);
+
+    std::string unclosed = str;
+    unclosed.erase(unclosed.find("</catalogue><!--"));
+    REQUIRE_THROWS_AS(xml::parseParallel(unclosed, 4), xml::ParseError);
+    REQUIRE_THROWS_AS(xml::parseParallel(str + "<second/>", 4), xml::ParseError);
+}
+
+TEST_CASE("Batch", "[parallel]")
+{
+    std::vector<std::string> inputs;
+    std::size_t size = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        inputs.push_back(i % 50 == 7 ? "<message><broken></message>" :
+                         "<message id=\"" + std::to_string(i) + "\"><body>" + std::string(static_cast<std::size_t>(i) + 1, 'x') + "</body></message>");
+        size += inputs.back().size();
+    }
+
+    for (const std::size_t threads : {1, 3, 1000})
+    {
+        const xml::BatchResult result = xml::parseBatch(inputs, threads);
+
+        REQUIRE(result.items.size() == inputs.size());
+        REQUIRE(result.bytes == size);
+        REQUIRE(result.getThroughput() > 0.0);
+
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            const auto& item = result.items[i];
+            if (i % 50 == 7)
+            {
+                REQUIRE(item.error);
+                REQUIRE_THROWS_AS(std::rethrow_exception(item.error), xml::ParseError);
+            }
+            else
+            {
+                REQUIRE_FALSE(item.error);
+                REQUIRE(xml::encode(item.data) == inputs[i]);
+            }
+            REQUIRE(item.latency <= result.elapsed);
+        }
+    }
+
+    const std::vector<std::string_view> views{"<a/>", "<b> </b>"};
+    const auto preserved = xml::parseBatch(views, 2, true);
+    REQUIRE(xml::encode(preserved.items[1].data) == "<b> </b>");
+    REQUIRE(xml::parseBatch(std::vector<std::string>{}).items.empty());
+
+    // the threads and parsers of a batch parser are kept for every batch
+    xml::BatchParser parser{3};
+    REQUIRE(parser.getThreadCount() == 3);
+    for (const std::size_t count : {inputs.size(), std::size_t{2}, std::size_t{0}, inputs.size()})
+    {
+        const std::vector<std::string> batch(inputs.begin(), inputs.begin() + static_cast<std::ptrdiff_t>(count));
+        const xml::BatchResult result = parser.parse(batch);
+
+        REQUIRE(result.items.size() == count);
+        for (std::size_t i = 0; i < count; ++i)
+            REQUIRE(static_cast<bool>(result.items[i].error) == (i % 50 == 7));
+    }
+}
+
+TEST_CASE("Parallel encoding", "[parallel]")
+{
+    std::string str = "<?xml version=\"1.0\"?><!DOCTYPE d [<!ENTITY e \"x\">]><!--c--><export a=\"&amp;\"><list>";
+    for (int i = 0; i < 1000; ++i)
+        str += "<item id=\"" + std::to_string(i) + "\"><name>a &lt; b</name><empty/><![CDATA[<x>]]></item>";
+    str += "</list><single><deep><deeper>t</deeper></deep></single></export>";
+    const xml::Data d = xml::parse(str, false, true, true);
+
+    for (const std::size_t threads : {0, 1, 2, 8})
+        for (const bool whitespaces : {false, true})
+            for (const bool byteOrderMark : {false, true})
+                REQUIRE(xml::encodeParallel(d, threads, whitespaces, byteOrderMark) ==
+                        xml::encode(d, whitespaces, byteOrderMark));
+
+    REQUIRE(xml::encodeParallel(xml::Data{}).empty());
+
+    // a small document is encoded sequentially, with the same output
+    const xml::Data small = xml::parse("<r a=\"&lt;\"><b>t</b></r>");
+    REQUIRE(xml::encodeParallel(small, 8, true, true) == xml::encode(small, true, true));
+
+    xml::Data invalid;
+    auto& root = invalid.emplaceBack(xml::Node::Type::tag);
+    root.setName("root");
+    root.emplaceBack(static_cast<xml::Node::Type>(100));
+    REQUIRE_THROWS_AS(xml::encodeParallel(invalid, 2), xml::ParseError);
+
+    xml::Data largeInvalid = d;
+    for (xml::Node& node : largeInvalid)
+        if (node.getType() == xml::Node::Type::tag)
+            node.emplaceBack(static_cast<xml::Node::Type>(100));
+    REQUIRE_THROWS_AS(xml::encodeParallel(largeInvalid, 2), xml::ParseError);
+}
+
 TEST_CASE("Range-based for loop for data")
 {
     SECTION("Mutable")